@@ -0,0 +1,249 @@
+// Training and prediction throughput of a Tree on synthetic data, for every combination of the data shapes and
+// parameters given on the command line. Built with the standalone library (CMakeLists.txt), results in JSON or CSV
+// so that they can be compared between commits:
+//   cartcpp_bench --rows 10000,100000 --features 10,100 --classes 0,2 --format csv --tag $(git rev-parse HEAD)
+// Options (comma-separated lists of values, every combination is measured):
+//   --rows, --features, --classes (0 for a regression tree), --depth, --num-features (0 for all the features),
+//   --split-method, --threads, --approx-min-rows (0 for the exact split search), --approx-sample-size
+// and --repeats (timings are the median of the repeats), --seed, --format json|csv, --output file, --tag text.
+// The errors are measured on the training data and on test data drawn from the same distribution, e.g. to compare
+// the approximate split search with the exact one on tall data:
+//   cartcpp_bench --rows 1000000 --features 20 --classes 0,2 --approx-min-rows 0,100000 --format csv
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Tree.h"
+
+// Synthetic data: gaussian features, the label depends on the first features through linear and interaction terms
+// classification: classes of equal size cut at the quantiles of the score, regression: score with gaussian noise
+static void syntheticData(const arma::uword& numRows, const arma::uword& numCols, const int& numClasses,
+                          const std::uint64_t& seed, arma::mat& X, arma::colvec& Y) {
+  std::mt19937_64 generator(seed);
+  std::normal_distribution<double> normal;
+  X.set_size(numRows, numCols);
+  for (arma::uword i = 0; i < X.n_elem; ++i) {
+    X(i) = normal(generator);
+  }
+  const arma::uword used = std::min<arma::uword>(numCols, 5);
+  Y.set_size(numRows);
+  for (arma::uword row = 0; row < numRows; ++row) {
+    double score = 0.0;
+    for (arma::uword feature = 0; feature < used; ++feature) {
+      score += (double)(feature + 1) * X(row, feature);
+    }
+    if (numCols > 1) {
+      score += 2.0 * X(row, 0) * X(row, 1);
+    }
+    Y(row) = score + 0.5 * normal(generator);
+  }
+  if (numClasses > 0) {
+    std::vector<double> sorted(Y.begin(), Y.end());
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<double> cuts;
+    for (int k = 1; k < numClasses; ++k) {
+      cuts.push_back(sorted[(std::size_t)k * numRows / numClasses]);
+    }
+    for (arma::uword row = 0; row < numRows; ++row) {
+      Y(row) = (double)(std::upper_bound(cuts.begin(), cuts.end(), Y(row)) - cuts.begin());
+    }
+  }
+}
+
+static std::vector<long> parseList(const std::string& text) {
+  std::vector<long> values;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    values.push_back(std::stol(item));
+  }
+  if (values.empty()) {
+    throw std::range_error("Empty list of values: " + text);
+  }
+  return values;
+}
+
+static double median(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+static double seconds(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Result {
+  long _rows, _features, _classes, _depth, _numFeatures, _splitMethod, _threads, _approxMinRows, _approxSampleSize;
+  arma::uword _nodes;
+  double _trainSeconds, _predictSeconds, _trainingError, _testError;
+};
+
+// Misclassification rate OR MSE of the predictions
+static double predictionError(const arma::colvec& Ypred, const arma::colvec& Y, const bool& classification) {
+  double error = 0.0;
+  for (arma::uword row = 0; row < Y.n_elem; ++row) {
+    double residual = Ypred(row) - Y(row);
+    error += classification ? (double)(residual != 0.0) : residual * residual;
+  }
+  return error / (double)Y.n_elem;
+}
+
+// Train and predict with the tree of the parameters of the result, record the median timings of the repeats
+static void measure(const arma::mat& X, const arma::colvec& Y, const arma::mat& Xtest, const arma::colvec& Ytest,
+                    const int& repeats, const std::uint64_t& seed, Result& result) {
+  Tree tree(0, (result._classes > 0) ? 0 : 1, X.n_cols, result._numFeatures, (int)result._depth, 2,
+            (int)result._splitMethod);
+  tree.setNumThreads((int)result._threads);
+  tree.setApproxMinRows((int)result._approxMinRows);
+  tree.setApproxSampleSize((int)result._approxSampleSize);
+  std::vector<double> trainTimes, predictTimes;
+  arma::colvec Ypred;
+  for (int r = 0; r < repeats; ++r) {
+    Tree::seedRandom(seed); // every repeat grows the same tree
+    auto start = std::chrono::steady_clock::now();
+    tree.train(X, Y);
+    trainTimes.push_back(seconds(start));
+    start = std::chrono::steady_clock::now();
+    Ypred = tree.predict(X, (int)result._threads);
+    predictTimes.push_back(seconds(start));
+  }
+  result._nodes = tree.print().n_rows;
+  result._trainSeconds = median(trainTimes);
+  result._predictSeconds = median(predictTimes);
+  // the training error only changes with the trees, the test error shows the accuracy lost by approximations
+  result._trainingError = predictionError(Ypred, Y, result._classes > 0);
+  result._testError = predictionError(tree.predict(Xtest, (int)result._threads), Ytest, result._classes > 0);
+}
+
+int main(int argc, char** argv) {
+  std::vector<long> rows = {10000, 100000}, features = {10, 100}, classes = {2}, depths = {8}, numFeatures = {0},
+    splitMethods = {0, 2}, threads = {1}, approxMinRows = {0}, approxSampleSizes = {10000};
+  int repeats = 3;
+  std::uint64_t seed = 1;
+  std::string format = "json", output, tag;
+  std::map<std::string, std::vector<long>*> lists = {
+    {"--rows", &rows}, {"--features", &features}, {"--classes", &classes}, {"--depth", &depths},
+    {"--num-features", &numFeatures}, {"--split-method", &splitMethods}, {"--threads", &threads},
+    {"--approx-min-rows", &approxMinRows}, {"--approx-sample-size", &approxSampleSizes}};
+  std::map<std::string, std::string*> texts = {{"--format", &format}, {"--output", &output}, {"--tag", &tag}};
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string option = argv[i];
+      if (i + 1 >= argc) {
+        throw std::range_error("Missing value of " + option);
+      }
+      std::string value = argv[++i];
+      if (lists.count(option) > 0) {
+        *lists[option] = parseList(value);
+      } else if (texts.count(option) > 0) {
+        *texts[option] = value;
+      } else if (option == "--repeats") {
+        repeats = std::max(1, std::stoi(value));
+      } else if (option == "--seed") {
+        seed = std::stoull(value);
+      } else {
+        throw std::range_error("Unknown option " + option);
+      }
+    }
+    if (format != "json" && format != "csv") {
+      throw std::range_error("Format should be json or csv");
+    }
+  } catch (const std::exception& error) {
+    std::cerr << error.what() << std::endl;
+    return 2;
+  }
+
+  std::vector<Result> results;
+  arma::mat X, Xtest;
+  arma::colvec Y, Ytest;
+  try {
+    for (long numRows : rows) for (long numCols : features) for (long numClasses : classes) {
+      syntheticData(numRows, numCols, (int)numClasses, seed, X, Y);
+      syntheticData(numRows, numCols, (int)numClasses, seed + 1, Xtest, Ytest);
+      for (long depth : depths) for (long sampled : numFeatures) for (long splitMethod : splitMethods) {
+        for (long numThreads : threads) for (long approx : approxMinRows) for (long sampleSize : approxSampleSizes) {
+          Result result = {numRows, numCols, numClasses, depth, (sampled <= 0) ? numCols : std::min(sampled, numCols),
+                           splitMethod, numThreads, approx, sampleSize, 0, 0.0, 0.0, 0.0, 0.0};
+          measure(X, Y, Xtest, Ytest, repeats, seed, result);
+          results.push_back(result);
+          std::cerr << "rows " << numRows << " features " << numCols << " classes " << numClasses << " depth "
+                    << depth << " numFeatures " << result._numFeatures << " splitMethod " << splitMethod
+                    << " threads " << numThreads << " approxMinRows " << approx << " approxSampleSize "
+                    << sampleSize << ": train " << result._trainSeconds << " s, predict " << result._predictSeconds
+                    << " s, test error " << result._testError << std::endl;
+        }
+      }
+    }
+  } catch (const std::exception& error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
+  }
+
+  std::ofstream file;
+  if (!output.empty()) {
+    file.open(output);
+    if (!file) {
+      std::cerr << "Cannot open file " << output << std::endl;
+      return 2;
+    }
+  }
+  std::ostream& out = output.empty() ? std::cout : file;
+  const char* names[] = {"tag", "rows", "features", "classes", "depth", "numFeatures", "splitMethod", "threads",
+                         "approxMinRows", "approxSampleSize", "repeats", "nodes", "trainSeconds",
+                         "trainRowsPerSecond", "predictSeconds", "predictRowsPerSecond", "trainingError", "testError"};
+  const std::size_t numNames = sizeof(names) / sizeof(names[0]);
+  if (format == "csv") {
+    for (std::size_t k = 0; k < numNames; ++k) {
+      out << (k > 0 ? "," : "") << names[k];
+    }
+    out << "\n";
+  } else {
+    out << "[\n";
+  }
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    std::ostringstream values[numNames];
+    for (auto& value : values) {
+      value.precision(9);
+    }
+    values[0] << (format == "csv" ? tag : "\"" + tag + "\"");
+    values[1] << r._rows;
+    values[2] << r._features;
+    values[3] << r._classes;
+    values[4] << r._depth;
+    values[5] << r._numFeatures;
+    values[6] << r._splitMethod;
+    values[7] << r._threads;
+    values[8] << r._approxMinRows;
+    values[9] << r._approxSampleSize;
+    values[10] << repeats;
+    values[11] << r._nodes;
+    values[12] << r._trainSeconds;
+    values[13] << (double)r._rows / r._trainSeconds;
+    values[14] << r._predictSeconds;
+    values[15] << (double)r._rows / r._predictSeconds;
+    values[16] << r._trainingError;
+    values[17] << r._testError;
+    out << (format == "csv" ? "" : "  {");
+    for (std::size_t k = 0; k < numNames; ++k) {
+      if (format == "csv") {
+        out << (k > 0 ? "," : "") << values[k].str();
+      } else {
+        out << (k > 0 ? ", " : "") << "\"" << names[k] << "\": " << values[k].str();
+      }
+    }
+    out << (format == "csv" ? "\n" : (i + 1 < results.size() ? "},\n" : "}\n"));
+  }
+  if (format == "json") {
+    out << "]\n";
+  }
+  return 0;
+}
@@ -0,0 +1,342 @@
+//  Booster.cpp
+// Retrieve the definition of our Booster class
+#include "Booster.h"
+
+// Constructors
+Booster::Booster(const int& numRounds, const int& loss, const arma::uword& maxNumFeatures,
+                 const arma::uword& numFeatures, const int& maxDepth, const int& minCount):
+  Booster(numRounds, loss, maxNumFeatures, numFeatures, maxDepth, minCount, 0) {}
+
+Booster::Booster(const int& numRounds, const int& loss, const arma::uword& maxNumFeatures,
+                 const arma::uword& numFeatures, const int& maxDepth, const int& minCount,
+                 const int& splitMethod):
+  _numRounds(numRounds),
+  _loss(loss),
+  _maxNumFeatures(maxNumFeatures),
+  _numFeatures(numFeatures),
+  _maxDepth(maxDepth),
+  _minCount(minCount),
+  _splitMethod(splitMethod) {
+  // Input checks
+  if (_numRounds <= 0) {
+    throw std::range_error("Number of rounds should be > 0");
+  }
+  if (_loss < 0 || _loss > 1) {
+    throw std::range_error("Loss should be either 0 or 1");
+  }
+  // the parameters of the trees are checked by the Tree constructor
+  Tree(0, 1, _maxNumFeatures, _numFeatures, _maxDepth, _minCount, _splitMethod);
+}
+
+// Methods
+double Booster::getLearningRate() const {
+  return _learningRate;
+}
+
+void Booster::setLearningRate(double learningRate) {
+  if (!(learningRate > 0.0)) {
+    throw std::range_error("Learning rate should be > 0");
+  }
+  _learningRate = learningRate;
+}
+
+double Booster::getSubsample() const {
+  return _subsample;
+}
+
+void Booster::setSubsample(double subsample) {
+  if (!(subsample > 0.0 && subsample <= 1.0)) {
+    throw std::range_error("Subsample should be in (0, 1]");
+  }
+  _subsample = subsample;
+}
+
+int Booster::getEarlyStopping() const {
+  return _earlyStopping;
+}
+
+void Booster::setEarlyStopping(int earlyStopping) {
+  if (earlyStopping < 0) {
+    throw std::range_error("Early stopping rounds should be >= 0");
+  }
+  _earlyStopping = earlyStopping;
+}
+
+int Booster::getNumThreads() const {
+  return _numThreads;
+}
+
+void Booster::setNumThreads(int numThreads) {
+  if (numThreads <= 0) {
+    throw std::range_error("Number of threads should be > 0");
+  }
+  _numThreads = numThreads;
+}
+
+int Booster::getFeatureStorage() const {
+  return _featureStorage;
+}
+
+void Booster::setFeatureStorage(int featureStorage) {
+  if (featureStorage < 0 || featureStorage > 2) {
+    throw std::range_error("Feature storage should be 0 (double), 1 (float32) or 2 (uint16 codes)");
+  }
+  _featureStorage = featureStorage;
+}
+
+int Booster::getNumTrees() const {
+  return (int)_trees.size();
+}
+
+void Booster::train(const arma::mat &X, const arma::colvec &Y) {
+  // Input(explicit): data
+  // Output: none
+  // Process: boost regression trees on the data
+  checkData(X, Y);
+  fit(X, Y, nullptr, nullptr);
+}
+
+void Booster::train(const arma::mat &X, const arma::colvec &Y, const arma::mat &Xvalid, const arma::colvec &Yvalid) {
+  // Input(explicit): data, validation data
+  // Output: none
+  // Process: boost regression trees on the data, keep the trees up to the best round on the validation data
+  checkData(X, Y);
+  checkData(Xvalid, Yvalid);
+  fit(X, Y, &Xvalid, &Yvalid);
+}
+
+void Booster::checkData(const arma::mat& X, const arma::colvec& Y) const {
+  // Input checks
+  if (X.n_cols != _maxNumFeatures) {
+    throw std::range_error("Dataset should have number of features = max number of features");
+  }
+  if (X.n_rows <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+  if (Y.n_elem != X.n_rows) {
+    throw std::range_error("Mismatch between dimensions of X and Y");
+  }
+  if (_loss == 1) {
+    for (const auto& y : Y) {
+      if (y != 0.0 && y != 1.0) {
+        throw std::range_error("Labels should be 0 or 1 for the logistic loss");
+      }
+    }
+  }
+}
+
+void Booster::fit(const arma::mat& X, const arma::colvec& Y, const arma::mat* Xvalid, const arma::colvec* Yvalid) {
+  // Input: data, validation data (optional)
+  // Output: none
+  // Process: fit a regression tree to the negative gradients in every round, set its leaves by a Newton step
+  // and add it to the scores of the data points
+
+  // the data is sorted or quantized once, every round only replaces the labels
+  Dataset data(X, Y, 1, _featureStorage);
+  data.prepare(_splitMethod);
+  const arma::uword numRows = X.n_rows;
+
+  // initial score: mean (squared error) OR log-odds of the mean (logistic loss)
+  double mean = arma::mean(Y);
+  if (_loss == 0) {
+    _baseScore = mean;
+  } else {
+    mean = std::min(std::max(mean, 1e-6), 1.0 - 1e-6);
+    _baseScore = std::log(mean / (1.0 - mean));
+  }
+  arma::colvec scores(numRows), residuals(numRows), hessians(numRows), validScores;
+  scores.fill(_baseScore);
+  if (Xvalid != nullptr) {
+    validScores.set_size(Xvalid->n_rows);
+    validScores.fill(_baseScore);
+  }
+
+  // the streams of the rounds are derived from a single draw of R's RNG
+  const std::uint64_t seed = Tree::drawSeed();
+  _trees.clear();
+  std::vector<std::uint32_t> leaves(numRows);
+  std::vector<double> sumResiduals, sumHessians;
+  double bestLoss = std::numeric_limits<double>::infinity();
+  int bestRound = 0;
+  for (int round = 0; round < _numRounds; ++round) {
+    // negative gradients and second derivatives of the loss at the current scores
+    for (arma::uword row = 0; row < numRows; ++row) {
+      if (_loss == 0) {
+        residuals(row) = Y(row) - scores(row);
+        hessians(row) = 1.0;
+      } else {
+        double p = 1.0 / (1.0 + std::exp(-scores(row)));
+        residuals(row) = Y(row) - p;
+        hessians(row) = p * (1.0 - p);
+      }
+    }
+    data.setLabels(residuals);
+
+    // grow the tree of the round on the drawn rows
+    std::uint64_t roundSeed = RandomStream::derive(seed, (std::uint64_t)round);
+    arma::uvec rows = (_subsample < 1.0) ? subsampleRows(roundSeed, numRows) :
+      arma::regspace<arma::uvec>(0, 1, numRows - 1);
+    Tree tree(round, 1, _maxNumFeatures, _numFeatures, _maxDepth, _minCount, _splitMethod);
+    tree.setNumThreads(_numThreads);
+    tree.train(data, rows, roundSeed);
+
+    // Newton step in every leaf, computed from the drawn rows, shrunk by the learning rate
+    findLeaves(tree, X, leaves);
+    sumResiduals.assign(tree._nodes.size(), 0.0);
+    sumHessians.assign(tree._nodes.size(), 0.0);
+    for (const auto& row : rows) {
+      sumResiduals[leaves[row]] += residuals(row);
+      sumHessians[leaves[row]] += hessians(row);
+    }
+    CompactNode* nodes = tree._nodes.ownedData();
+    for (std::size_t nd = 0; nd < tree._nodes.size(); ++nd) {
+      if (nodes[nd]._left == 0) {
+        nodes[nd]._value = (sumHessians[nd] > 0.0) ? _learningRate * sumResiduals[nd] / sumHessians[nd] : 0.0;
+      }
+    }
+
+    // only the new tree is added to the scores
+    for (arma::uword row = 0; row < numRows; ++row) {
+      scores(row) += tree._nodes[leaves[row]]._value;
+    }
+    _trees.push_back(std::move(tree));
+
+    if (Xvalid != nullptr) {
+      addTree(_trees.back(), *Xvalid, validScores);
+      double validLoss = loss(*Yvalid, validScores);
+      if (validLoss < bestLoss) {
+        bestLoss = validLoss;
+        bestRound = round;
+      } else if (_earlyStopping > 0 && round - bestRound >= _earlyStopping) {
+        break;
+      }
+    }
+  }
+  if (Xvalid != nullptr) {
+    _trees.resize(bestRound + 1); // keep the trees up to the best round on the validation data
+  }
+}
+
+arma::uvec Booster::subsampleRows(const std::uint64_t& seed, const arma::uword& numRows) const {
+  // Input: seed of the round, number of rows of the data
+  // Output: rows drawn without replacement for the round, in increasing order
+  // Process: partially shuffle the rows with the stream of the round
+
+  // the root of the tree uses the streams 1 and 2 for its children, the sample uses the stream 0
+  RandomStream stream(RandomStream::derive(seed, 0));
+  arma::uword size = std::max<arma::uword>(1, (arma::uword)std::floor(_subsample * (double)numRows + 0.5));
+  arma::uvec rows = arma::regspace<arma::uvec>(0, 1, numRows - 1);
+  for (arma::uword i = 0; i < size; ++i) {
+    std::swap(rows(i), rows(i + stream.below(numRows - i)));
+  }
+  rows = rows.head(size);
+  std::sort(rows.begin(), rows.end());
+  return rows;
+}
+
+void Booster::findLeaves(const Tree& tree, const arma::mat& X, std::vector<std::uint32_t>& leaves) const {
+  // Input: trained tree, data, buffer of X.n_rows nodes
+  // Output: none, leaves holds the leaf reached by every row of the data
+  // Process: the rows are processed in blocks, the blocks are shared between the threads
+
+  const arma::uword blockSize = tree.predictBlockSize();
+  const arma::uword numBlocks = (X.n_rows + blockSize - 1) / blockSize;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(_numThreads)
+#endif
+  {
+    std::vector<double> tile(blockSize * _maxNumFeatures);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (arma::uword block = 0; block < numBlocks; ++block) {
+      arma::uword first = block * blockSize;
+      arma::uword size = std::min(blockSize, X.n_rows - first);
+      Tree::fillTile(X, first, size, tile.data());
+      tree.descendBlock(X, first, size, tile.data(), leaves.data() + first);
+    }
+  }
+}
+
+void Booster::addTree(const Tree& tree, const arma::mat& X, arma::colvec& scores) const {
+  // Input: trained tree, data, scores of the data
+  // Output: none
+  // Process: add the prediction of the tree to the score of every row
+  std::vector<std::uint32_t> leaves(X.n_rows);
+  findLeaves(tree, X, leaves);
+  for (arma::uword row = 0; row < X.n_rows; ++row) {
+    scores(row) += tree._nodes[leaves[row]]._value;
+  }
+}
+
+double Booster::loss(const arma::colvec& Y, const arma::colvec& scores) const {
+  // Input: labels, scores
+  // Output: mean squared error (squared error) OR mean negative log-likelihood (logistic loss)
+  double total = 0.0;
+  for (arma::uword row = 0; row < Y.n_elem; ++row) {
+    if (_loss == 0) {
+      total += (Y(row) - scores(row)) * (Y(row) - scores(row));
+    } else {
+      // log(1 + exp(s)) - y * s without overflow
+      double s = scores(row);
+      total += std::max(s, 0.0) - Y(row) * s + std::log1p(std::exp(-std::fabs(s)));
+    }
+  }
+  return total / (double)Y.n_elem;
+}
+
+arma::colvec Booster::predict(const arma::mat& X) const {
+  return predict(X, 1);
+}
+
+arma::colvec Booster::predict(const arma::mat& X, const int& numThreads) const {
+  // Input checks
+  if (_trees.empty()) {
+    throw std::range_error("The model should be trained before making predictions");
+  }
+  if (X.n_rows <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+  if (X.n_cols != _maxNumFeatures) {
+    throw std::range_error("Data set should have the number of features = max number of features");
+  }
+  if (numThreads <= 0) {
+    throw std::range_error("Number of threads should be > 0");
+  }
+
+  // vector to store predicted values
+  arma::colvec Ypred(X.n_rows);
+
+  // the rows are processed in blocks shared between the threads, every tree runs on the tile of the block
+  // while it is in cache
+  const arma::uword blockSize = _trees[0].predictBlockSize();
+  const arma::uword numBlocks = (X.n_rows + blockSize - 1) / blockSize;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads)
+#endif
+  {
+    // per thread buffers: row-major copy of the block, current node and score of every row
+    std::vector<double> tile(blockSize * _maxNumFeatures);
+    std::vector<std::uint32_t> nodeIndex(blockSize);
+    std::vector<double> scores(blockSize);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (arma::uword block = 0; block < numBlocks; ++block) {
+      arma::uword first = block * blockSize;
+      arma::uword size = std::min(blockSize, X.n_rows - first);
+      Tree::fillTile(X, first, size, tile.data());
+      std::fill(scores.begin(), scores.end(), _baseScore);
+      for (const auto& tree : _trees) {
+        tree.descendBlock(X, first, size, tile.data(), nodeIndex.data());
+        for (arma::uword i = 0; i < size; ++i) {
+          scores[i] += tree._nodes[nodeIndex[i]]._value;
+        }
+      }
+      for (arma::uword i = 0; i < size; ++i) {
+        Ypred(first + i) = (_loss == 0) ? scores[i] : 1.0 / (1.0 + std::exp(-scores[i]));
+      }
+    }
+  }
+  return Ypred;
+}
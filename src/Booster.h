@@ -0,0 +1,150 @@
+//' @name Booster$new
+//' @title Constructs a new Booster object
+//' @param numRounds Maximum number of boosting rounds, i.e. of regression trees
+//' @param loss 0 for squared error (regression) and 1 for logistic loss (binary classification with 0/1 labels)
+//' @param maxNumFeatures Number of features in the data set on which the model is trained
+//' @param numFeatures Number of features selected at each split of every tree
+//' @param maxDepth The maximum depth to which the trees are grown
+//' @param minCount Minimum number of data points for a node to qualify as a leaf node
+//' @param splitMethod (optional) split method of the trees, see \code{Tree$new}. The data is sorted or quantized
+//' only once for all the rounds
+//' @examples
+//' # Create a new object of class Booster with at most 200 trees of depth 3
+//' bst = new(Booster, numRounds = 200, loss = 0, maxNumFeatures = 10,
+//' numFeatures = 10, maxDepth = 3, minCount = 5)
+//' # Same model, but the splits are searched over the histograms of the features
+//' bst = new(Booster, numRounds = 200, loss = 0, maxNumFeatures = 10,
+//' numFeatures = 10, maxDepth = 3, minCount = 5, splitMethod = 2)
+
+//' @name Booster$train
+//' @title Fits a Booster object to the given data
+//' @description Every round fits a regression tree to the negative gradients of the loss and sets the values of its
+//' leaves by a Newton step. With a validation set, the training stops once the validation loss has not improved for
+//' earlyStopping rounds and the model keeps the trees up to the best round.
+//' @param X  Data matrix
+//' @param Y  Vector of labels
+//' @param Xvalid (optional) Validation data matrix
+//' @param Yvalid (optional) Vector of validation labels
+//' @examples
+//' X = matrix(rnorm(4000), ncol = 4)
+//' Y = X[, 1] + X[, 2]^2 + rnorm(1000, sd = 0.1)
+//' bst = new(Booster, numRounds = 500, loss = 0, maxNumFeatures = 4,
+//' numFeatures = 4, maxDepth = 3, minCount = 5)
+//' bst$earlyStopping = 10
+//' bst$train(X[1:800, ], Y[1:800], X[801:1000, ], Y[801:1000])
+//' bst$numTrees
+
+//' @name Booster$predict
+//' @title Calculates predictions based on the Booster model
+//' @param X  Data matrix
+//' @param numThreads (optional) Number of threads sharing the rows of the data matrix, 1 by default
+//' @return Vector of predictions corresponding to the data: predicted values (squared error) or probabilities of
+//' the label 1 (logistic loss).
+//' @examples
+//' # Assume a trained Booster object, bst
+//' Xtest = matrix(rnorm(40), ncol = 4)
+//' bst$predict(Xtest)
+
+#ifndef Booster_H
+#define Booster_H
+#include <vector>
+#include <cstdint>
+#include "CartArmadillo.h"
+#include "Tree.h"
+
+//' @name Booster
+//' @title Gradient boosted CART models
+//' @description Gradient boosting with regression Tree models as the weak learners. The data is preprocessed once
+//' and reused by all the rounds, and the scores of the data points are updated with the new tree only, so that the
+//' cost of a round is the growth of its tree.
+//' @field new Constructor of the class. \itemize{
+//' \item Parameter: numRounds - maximum number of boosting rounds
+//' \item Parameter: loss - 0 for squared error and 1 for logistic loss
+//' \item Parameter: maxNumFeatures - number of features in the data set on which the model is trained
+//' \item Parameter: numFeatures - number of features selected at each split of every tree
+//' \item Parameter: maxDepth - the maximum depth to which the trees are grown
+//' \item Parameter: minCount - minimum number of data points for a node to qualify as a leaf node
+//' \item Parameter: splitMethod - (optional) split method of the trees, see \code{Tree}
+//' }
+//' @field train Train the model on the data. \itemize{
+//' \item Parameter: X - data matrix
+//' \item Parameter: Y - vector of labels
+//' \item Parameter: Xvalid - (optional) validation data matrix used for early stopping
+//' \item Parameter: Yvalid - (optional) vector of validation labels
+//' }
+//' @field predict Calculate predictions based on the model: predicted values (squared error) or probabilities of the
+//' label 1 (logistic loss). \itemize{
+//' \item Parameter: X - data matrix, based on which predictions are made
+//' \item Parameter: numThreads - (optional) number of threads used for the predictions
+//' \item Returns: Y - vector of predicted values
+//' }
+//' @field learningRate Shrinkage applied to every tree, 0.1 by default
+//' @field subsample Share of the data points drawn without replacement for every tree, 1 by default
+//' @field earlyStopping Number of rounds without improvement of the validation loss after which the training stops,
+//' 0 (never stop) by default. Only used when a validation set is given to train
+//' @field numThreads Number of threads used to grow every tree and update the scores, 1 by default
+//' @field featureStorage Storage of the training data shared by the rounds, see \code{Tree}. 0 by default
+//' @field numTrees Number of trees of the trained model
+//' @examples
+//' X = matrix(rnorm(4000), ncol = 4)
+//' Y = as.numeric(X[, 1] + X[, 2] > 0)
+//' bst = new(Booster, numRounds = 100, loss = 1, maxNumFeatures = 4,
+//' numFeatures = 4, maxDepth = 3, minCount = 5)
+//' bst$learningRate = 0.2
+//' bst$subsample = 0.8
+//' bst$train(X, Y)
+//' bst$predict(X)
+class Booster {
+public:
+  // constructors
+  Booster(const int& numRounds, const int& loss, const arma::uword& maxNumFeatures,
+          const arma::uword& numFeatures, const int& maxDepth, const int& minCount);
+  Booster(const int& numRounds, const int& loss, const arma::uword& maxNumFeatures,
+          const arma::uword& numFeatures, const int& maxDepth, const int& minCount,
+          const int& splitMethod);
+
+  // public methods
+  void train(const arma::mat& X, const arma::colvec& Y);
+  void train(const arma::mat& X, const arma::colvec& Y, const arma::mat& Xvalid, const arma::colvec& Yvalid);
+  double getLearningRate() const;
+  void setLearningRate(double learningRate);
+  double getSubsample() const;
+  void setSubsample(double subsample);
+  int getEarlyStopping() const;
+  void setEarlyStopping(int earlyStopping);
+  int getNumThreads() const;
+  void setNumThreads(int numThreads);
+  int getFeatureStorage() const;
+  void setFeatureStorage(int featureStorage);
+  int getNumTrees() const;
+  arma::colvec predict(const arma::mat& X) const;
+  arma::colvec predict(const arma::mat& X, const int& numThreads) const;
+
+protected:
+  // protected methods
+  void fit(const arma::mat& X, const arma::colvec& Y, const arma::mat* Xvalid, const arma::colvec* Yvalid);
+  void checkData(const arma::mat& X, const arma::colvec& Y) const;
+  arma::uvec subsampleRows(const std::uint64_t& seed, const arma::uword& numRows) const;
+  void findLeaves(const Tree& tree, const arma::mat& X, std::vector<std::uint32_t>& leaves) const;
+  void addTree(const Tree& tree, const arma::mat& X, arma::colvec& scores) const;
+  double loss(const arma::colvec& Y, const arma::colvec& scores) const;
+
+protected:
+  // protected fields
+  int _numRounds; // maximum number of rounds
+  int _loss; // loss 0: squared error OR 1: logistic loss
+  arma::uword _maxNumFeatures; // total features available
+  arma::uword _numFeatures; // number of features selected at each split
+  int _maxDepth; // maxDepth of the trees
+  int _minCount; // min count of points for a leaf
+  int _splitMethod = 0; // split method of the trees
+  double _learningRate = 0.1; // shrinkage of the trees
+  double _subsample = 1.0; // share of the data points drawn for every tree
+  int _earlyStopping = 0; // rounds without improvement of the validation loss before stopping, 0: never
+  int _numThreads = 1; // number of threads growing the trees
+  int _featureStorage = 0; // storage of the training data shared by the rounds
+  double _baseScore = 0.0; // initial score of every data point
+  std::vector<Tree> _trees; // trained trees, the leaves hold the shrunk Newton steps
+};
+
+#endif
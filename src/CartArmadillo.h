@@ -0,0 +1,13 @@
+#ifndef CartArmadillo_H
+#define CartArmadillo_H
+// Armadillo for the core of the package (trees, forests, boosting, datasets). The R package uses the Armadillo of
+// RcppArmadillo, the standalone C++ library (CMakeLists.txt, CARTCPP_STANDALONE) uses a system Armadillo and has
+// no dependency on R.
+#ifdef CARTCPP_STANDALONE
+#include <armadillo>
+#else
+#include "RcppArmadillo.h"
+// [[Rcpp::depends(RcppArmadillo)]]
+#endif
+
+#endif
@@ -0,0 +1,261 @@
+//  ColumnFile.cpp
+// Retrieve the definition of our ColumnFile class
+#include "ColumnFile.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+// Header of the data file and of the label file, followed by the columns of the data (column f at byte
+// 64 + 8 * f * numRows) OR by the labels. All the fields and values are little-endian doubles and integers.
+struct ColumnsHeader {
+  char _magic[8]; // "CARTCOL" followed by 0
+  std::uint32_t _version;
+  std::uint32_t _reserved;
+  std::uint64_t _numRows;
+  std::uint64_t _numCols; // 1 for the label file
+  unsigned char _padding[32];
+};
+static_assert(sizeof(ColumnsHeader) == 64, "The column file header should take 64 bytes");
+static const char columnsMagic[8] = {'C', 'A', 'R', 'T', 'C', 'O', 'L', 0};
+static const std::uint32_t columnsVersion = 1;
+// Rows of the CSV file written to the columns at once: about 64MB of values
+static const std::size_t csvBlockValues = (std::size_t)1 << 23;
+
+static void checkByteOrder() {
+  // the columns are used in place, which needs a little-endian host
+  const std::uint16_t one = 1;
+  if (*reinterpret_cast<const unsigned char*>(&one) != 1) {
+    throw std::runtime_error("Column files are only supported on little-endian hosts");
+  }
+}
+
+static ColumnsHeader columnsHeader(const arma::uword& numRows, const arma::uword& numCols) {
+  ColumnsHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header._magic, columnsMagic, sizeof(columnsMagic));
+  header._version = columnsVersion;
+  header._numRows = numRows;
+  header._numCols = numCols;
+  return header;
+}
+
+static ColumnsHeader readHeader(const MappedFile& file, const std::string& path) {
+  ColumnsHeader header;
+  if (file.size() < sizeof(header)) {
+    throw std::range_error("File " + path + " is not a column file");
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (std::memcmp(header._magic, columnsMagic, sizeof(columnsMagic)) != 0) {
+    throw std::range_error("File " + path + " is not a column file");
+  }
+  if (header._version != columnsVersion) {
+    throw std::range_error("Unsupported version of the column file " + path);
+  }
+  if (file.size() != sizeof(header) + header._numRows * header._numCols * sizeof(double)) {
+    throw std::range_error("File " + path + " is a corrupted column file");
+  }
+  return header;
+}
+
+static void createFile(std::ofstream& file, const std::string& path, const ColumnsHeader& header) {
+  file.open(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("Cannot open file " + path);
+  }
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+static void writeValues(std::ofstream& file, const double* values, const arma::uword& size, const std::string& path) {
+  file.write(reinterpret_cast<const char*>(values), (std::streamsize)(size * sizeof(double)));
+  if (!file) {
+    throw std::runtime_error("Cannot write file " + path);
+  }
+}
+
+// Fields of a line of a CSV file, without the surrounding spaces and quotes
+static void splitFields(const std::string& line, std::vector<std::string>& fields) {
+  fields.clear();
+  std::size_t begin = 0;
+  while (true) {
+    std::size_t end = line.find(',', begin);
+    std::size_t last = (end == std::string::npos) ? line.size() : end;
+    std::size_t first = begin;
+    while (first < last && (line[first] == ' ' || line[first] == '"')) {
+      ++first;
+    }
+    while (last > first && (line[last - 1] == ' ' || line[last - 1] == '"' || line[last - 1] == '\r')) {
+      --last;
+    }
+    fields.push_back(line.substr(first, last - first));
+    if (end == std::string::npos) {
+      break;
+    }
+    begin = end + 1;
+  }
+}
+
+// Value of a field of a CSV file, the empty and NA fields are missing
+static double fieldValue(const std::string& field, const std::size_t& lineNumber, const std::string& path) {
+  if (field.empty() || field == "NA") {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  char* end = nullptr;
+  double value = std::strtod(field.c_str(), &end);
+  if (*end != 0) {
+    throw std::range_error("Line " + std::to_string(lineNumber) + " of " + path + " holds a field which is not "
+                           "a number");
+  }
+  return value;
+}
+
+void writeColumns(const arma::mat& X, const arma::colvec& Y, const std::string& path) {
+  // Input: data, labels, path of the data file
+  // Output: none
+  // Process: the matrix is stored column by column, so that its memory is the content of the data file
+
+  // Input checks
+  if (X.n_rows <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+  if (Y.n_elem != X.n_rows) {
+    throw std::range_error("Mismatch between dimensions of X and Y");
+  }
+  checkByteOrder();
+
+  std::ofstream data, labels;
+  createFile(data, path, columnsHeader(X.n_rows, X.n_cols));
+  writeValues(data, X.memptr(), X.n_elem, path);
+  createFile(labels, path + ".labels", columnsHeader(Y.n_elem, 1));
+  writeValues(labels, Y.memptr(), Y.n_elem, path + ".labels");
+}
+
+void csvToColumns(const std::string& csvPath, const std::string& path, const int& labelColumn, const bool& header) {
+  // Input: path of the CSV file, path of the data file, column of the labels (starting with 1), header line
+  // Output: none
+  // Process: count the rows, then read the CSV file by blocks of rows and write the part of every column held by
+  // the block at its place in the data file, the labels are appended to the label file
+
+  checkByteOrder();
+  std::ifstream csv(csvPath);
+  if (!csv) {
+    throw std::runtime_error("Cannot open file " + csvPath);
+  }
+  std::string line;
+  std::vector<std::string> fields;
+  arma::uword numRows = 0, numCols = 0;
+  bool first = true;
+  while (std::getline(csv, line)) {
+    if (line.empty() || line == "\r") {
+      continue;
+    }
+    if (first) {
+      splitFields(line, fields);
+      numCols = fields.size() - 1;
+      first = false;
+      if (header) {
+        continue;
+      }
+    }
+    ++numRows;
+  }
+  if (labelColumn < 1 || (arma::uword)labelColumn > numCols + 1) {
+    throw std::range_error("Label column should be a column of the CSV file");
+  }
+  if (numRows <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+
+  std::ofstream data, labels;
+  createFile(data, path, columnsHeader(numRows, numCols));
+  createFile(labels, path + ".labels", columnsHeader(numRows, 1));
+  const arma::uword blockRows = std::max<arma::uword>(1, csvBlockValues / std::max<arma::uword>(1, numCols));
+  arma::mat block(std::min(blockRows, numRows), numCols);
+  arma::colvec blockLabels(block.n_rows);
+  arma::uword blockSize = 0, firstRow = 0;
+  auto writeBlock = [&]() {
+    for (arma::uword feature = 0; feature < numCols; ++feature) {
+      data.seekp((std::streamoff)(sizeof(ColumnsHeader) + (feature * numRows + firstRow) * sizeof(double)));
+      writeValues(data, block.colptr(feature), blockSize, path);
+    }
+    writeValues(labels, blockLabels.memptr(), blockSize, path + ".labels");
+    firstRow += blockSize;
+    blockSize = 0;
+  };
+
+  csv.clear();
+  csv.seekg(0);
+  std::size_t lineNumber = 0;
+  first = true;
+  while (std::getline(csv, line)) {
+    ++lineNumber;
+    if (line.empty() || line == "\r") {
+      continue;
+    }
+    if (first) {
+      first = false;
+      if (header) {
+        continue;
+      }
+    }
+    splitFields(line, fields);
+    if (fields.size() != numCols + 1) {
+      throw std::range_error("Line " + std::to_string(lineNumber) + " of " + csvPath + " should have " +
+                             std::to_string(numCols + 1) + " fields");
+    }
+    arma::uword feature = 0;
+    for (std::size_t k = 0; k < fields.size(); ++k) {
+      double value = fieldValue(fields[k], lineNumber, csvPath);
+      if ((int)k + 1 == labelColumn) {
+        if (std::isnan(value)) {
+          throw std::range_error("Line " + std::to_string(lineNumber) + " of " + csvPath + " has no label");
+        }
+        blockLabels(blockSize) = value;
+      } else {
+        block(blockSize, feature++) = value;
+      }
+    }
+    if (++blockSize == block.n_rows) {
+      writeBlock();
+    }
+  }
+  if (blockSize > 0) {
+    writeBlock();
+  }
+}
+
+// Constructors
+ColumnFile::ColumnFile(const std::string& path):
+  _path(path),
+  _file(path) {
+  checkByteOrder();
+  ColumnsHeader header = readHeader(_file, path);
+  _numRows = header._numRows;
+  _numCols = header._numCols;
+}
+
+// Methods
+const double* ColumnFile::column(const arma::uword& feature) const {
+  // Input: feature
+  // Output: first value of the column of the feature in the mapped file
+  return reinterpret_cast<const double*>(_file.data() + sizeof(ColumnsHeader)) + feature * _numRows;
+}
+
+arma::colvec ColumnFile::labels() const {
+  // Input: none
+  // Output: labels of the data, read from the label file
+  MappedFile file(_path + ".labels");
+  ColumnsHeader header = readHeader(file, _path + ".labels");
+  if (header._numRows != _numRows || header._numCols != 1) {
+    throw std::range_error("File " + _path + ".labels does not hold the labels of " + _path);
+  }
+  return arma::colvec(reinterpret_cast<const double*>(file.data() + sizeof(header)), _numRows);
+}
+
+void ColumnFile::prefetch(const arma::uword& feature) const {
+  // Input: feature
+  // Output: none
+  // Process: ask the OS to read the column of the feature ahead of its use, without waiting for it
+  _file.prefetch(sizeof(ColumnsHeader) + feature * _numRows * sizeof(double), _numRows * sizeof(double));
+}
@@ -0,0 +1,62 @@
+#ifndef ColumnFile_H
+#define ColumnFile_H
+#include <cstdint>
+#include <string>
+#include "CartArmadillo.h"
+#include "MappedFile.h"
+
+//' @name writeColumns
+//' @title Writes a data set to column files for out-of-core training
+//' @description Writes the data in the column format read by the train methods of Tree and Forest when they are
+//' given a path: the file "path" holds one contiguous binary column (little-endian doubles) per feature and the file
+//' "path.labels" holds the labels. Training memory-maps the columns and only reads the ones sampled at every node,
+//' so that the data set does not need to fit in memory.
+//' @param X Data matrix, the missing values are NA
+//' @param Y Vector of labels
+//' @param path Path of the data file
+//' @examples
+//' X = matrix(1:12, nrow = 6, ncol = 2, byrow = TRUE)
+//' Y = c(rep(0, 3), rep(1, 3))
+//' path = tempfile()
+//' writeColumns(X, Y, path)
+//' tr = new(Tree, ident = 0, treeType = 0, maxNumFeatures = 2,
+//' numFeatures = 2, maxDepth = 4, minCount = 2)
+//' tr$train(path)
+void writeColumns(const arma::mat& X, const arma::colvec& Y, const std::string& path);
+
+//' @name csvToColumns
+//' @title Converts a CSV file to column files for out-of-core training
+//' @description Converts a CSV file of numbers to the column format written by writeColumns. The CSV file is read
+//' twice, once to count the rows and once to write blocks of rows to the columns, so that it does not need to fit
+//' in memory. Empty fields and NA are missing values, the labels should not be missing.
+//' @param csvPath Path of the CSV file
+//' @param path Path of the data file, the labels are written to "path.labels"
+//' @param labelColumn Column of the labels in the CSV file (starting with 1), the other columns are the features
+//' @param header Whether the first line of the CSV file holds the names of the columns
+//' @examples
+//' X = matrix(1:12, nrow = 6, ncol = 2, byrow = TRUE)
+//' csvPath = tempfile(fileext = ".csv")
+//' write.csv(data.frame(X, Y = c(rep(0, 3), rep(1, 3))), csvPath, row.names = FALSE)
+//' path = tempfile()
+//' csvToColumns(csvPath, path, labelColumn = 3, header = TRUE)
+void csvToColumns(const std::string& csvPath, const std::string& path, const int& labelColumn, const bool& header);
+
+// Data set read in place from the column files written by writeColumns(): the columns are memory-mapped, so that
+// only the pages of the columns read by the training are loaded, and the OS evicts them under memory pressure.
+class ColumnFile {
+public:
+  explicit ColumnFile(const std::string& path);
+  const double* column(const arma::uword& feature) const;
+  arma::colvec labels() const;
+  void prefetch(const arma::uword& feature) const;
+
+public:
+  const std::string _path;
+  arma::uword _numRows = 0;
+  arma::uword _numCols = 0;
+
+private:
+  MappedFile _file;
+};
+
+#endif
@@ -0,0 +1,328 @@
+//  Dataset.cpp
+// Retrieve the definition of our Dataset class
+#include "Dataset.h"
+#include <cfloat>
+#include <limits>
+
+// Constructors
+Dataset::Dataset(const arma::mat& X, const arma::colvec& Y, const int& treeType):
+  Dataset(X, Y, treeType, 0) {}
+
+Dataset::Dataset(const arma::mat& X, const arma::colvec& Y, const int& treeType, const int& storage):
+  // the double data is only kept for the storage 0, other storages copy it
+  _X(const_cast<double*>(X.memptr()), (storage == 0) ? X.n_rows : 0, (storage == 0) ? X.n_cols : 0, false, true),
+  _storage(storage),
+  _numRows(X.n_rows),
+  _numCols(X.n_cols),
+  _treeType(treeType) {
+  // Input checks
+  if (X.n_rows <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+  if (Y.n_elem != X.n_rows) {
+    throw std::range_error("Mismatch between dimensions of X and Y");
+  }
+  if (storage < 0 || storage > 2) {
+    throw std::range_error("Feature storage should be 0 (double), 1 (float32) or 2 (uint16 codes)");
+  }
+  setLabels(Y);
+  store(X);
+}
+
+Dataset::Dataset(const arma::sp_mat& X, const arma::colvec& Y, const int& treeType):
+  _rowMajor(X.t()),
+  _sparse(true),
+  _numRows(X.n_rows),
+  _numCols(X.n_cols),
+  _treeType(treeType) {
+  // Input checks
+  if (X.n_rows <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+  if (Y.n_elem != X.n_rows) {
+    throw std::range_error("Mismatch between dimensions of X and Y");
+  }
+  setLabels(Y);
+}
+
+Dataset::Dataset(const std::string& path, const int& treeType, const int& storage):
+  // the double data of the storage 0 is read in place from the mapped columns
+  _columns(new ColumnFile(path)),
+  _X(const_cast<double*>(_columns->column(0)), (storage == 0) ? _columns->_numRows : 0,
+     (storage == 0) ? _columns->_numCols : 0, false, true),
+  _storage(storage),
+  _numRows(_columns->_numRows),
+  _numCols(_columns->_numCols),
+  _treeType(treeType) {
+  // Input checks
+  if (_numRows <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+  if (storage < 0 || storage > 2) {
+    throw std::range_error("Feature storage should be 0 (double), 1 (float32) or 2 (uint16 codes)");
+  }
+  setLabels(_columns->labels());
+  store(arma::mat(const_cast<double*>(_columns->column(0)), _numRows, _numCols, false, true));
+}
+
+// Methods
+void Dataset::setLabels(const arma::colvec& Y) {
+  // Input: labels
+  // Output: none
+  // Process: replace the labels, encode the classes as 0..K-1 (classification) OR center the labels (regression)
+
+  if (Y.n_elem != _numRows) {
+    throw std::range_error("Mismatch between dimensions of X and Y");
+  }
+  _Y = Y;
+  if (_treeType == 0) {
+    // class counts are kept in flat arrays indexed by the class code
+    std::vector<double> classes(Y.begin(), Y.end());
+    std::sort(classes.begin(), classes.end());
+    classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+    _classValues = arma::vec(classes);
+    _labelCodes.set_size(Y.n_elem);
+    for (arma::uword row = 0; row < Y.n_elem; ++row) {
+      _labelCodes(row) = std::lower_bound(classes.begin(), classes.end(), Y(row)) - classes.begin();
+    }
+  } else {
+    // the sums of squares in the histograms do not lose precision on centered labels
+    _labelShift = arma::mean(Y);
+  }
+}
+
+void Dataset::prepare(const int& splitMethod) {
+  // Input: split method of the trees
+  // Output: none
+  // Process: build the preprocessed form of the data needed by the split method, unless it already exists
+  if (splitMethod < 0 || splitMethod > 2) {
+    throw std::range_error("Split method should be 0, 1 or 2");
+  }
+  if (_sparse && splitMethod != 0) {
+    throw std::range_error("Sparse data set should be used with splitMethod = 0");
+  }
+  if (splitMethod == 1 && _sortedRows.n_elem == 0) {
+    presort();
+  } else if (splitMethod == 2 && _bins.n_elem == 0) {
+    buildBins();
+  }
+}
+
+double Dataset::value(const arma::uword& row, const arma::uword& feature) const {
+  // Input: row, feature
+  // Output: value of the feature in the row, as seen by the splits: the threshold of the stored value
+  if (_sparse) {
+    return sparseValue(_rowMajor, row, feature);
+  }
+  if (_storage == 1) {
+    return threshold(feature, _Xf(row, feature));
+  }
+  if (_storage == 2) {
+    std::uint16_t code = _codes(row, feature);
+    return isMissing(code) ? std::numeric_limits<double>::quiet_NaN() : threshold(feature, code);
+  }
+  return _X(row, feature);
+}
+
+double Dataset::threshold(const arma::uword& feature, const float& value) const {
+  // Input: feature, value in single precision
+  // Output: largest double which rounds to the value, so that value <= v for the floats is x <= threshold(v)
+  // for the doubles
+  // Process: midpoint between the value and the next float (exact in double precision), minus one ulp when the
+  // midpoint rounds up
+  if (std::isnan(value) || value == std::numeric_limits<float>::infinity()) {
+    return value;
+  }
+  const double halfUlpMax = std::ldexp(1.0, 103); // half ulp of the largest float
+  double high;
+  if (value == -std::numeric_limits<float>::infinity()) {
+    high = -((double)FLT_MAX + halfUlpMax);
+  } else if (value == FLT_MAX) {
+    high = (double)FLT_MAX + halfUlpMax;
+  } else {
+    high = ((double)value + (double)std::nextafter(value, std::numeric_limits<float>::infinity())) / 2.0;
+  }
+  return ((float)high == value) ? high : std::nextafter(high, -std::numeric_limits<double>::infinity());
+}
+
+std::uint16_t Dataset::code(const arma::uword& feature, const double& value) const {
+  // Input: feature, value
+  // Output: code of the value: first code whose largest value is not below it
+  if (std::isnan(value)) {
+    return missingCode;
+  }
+  const arma::vec& values = _codeValues[feature];
+  return (std::uint16_t)(std::lower_bound(values.begin(), values.end(), value) - values.begin());
+}
+
+double Dataset::sparseValue(const arma::sp_mat& rowMajor, const arma::uword& row, const arma::uword& feature) {
+  // Input: sparse data with one column per row, row, feature
+  // Output: value of the feature in the row
+  // Process: binary search of the feature among the nonzeros of the row
+  const arma::uword* begin = rowMajor.row_indices + rowMajor.col_ptrs[row];
+  const arma::uword* end = rowMajor.row_indices + rowMajor.col_ptrs[row + 1];
+  const arma::uword* nonzero = std::lower_bound(begin, end, feature);
+  return (nonzero != end && *nonzero == feature) ? rowMajor.values[nonzero - rowMajor.row_indices] : 0.0;
+}
+
+void Dataset::store(const arma::mat& X) {
+  // Input: data
+  // Output: none
+  // Process: copy the data in single precision (storage 1) OR as codes (storage 2), the storage 0 uses it in place
+  if (_storage == 1) {
+    _Xf = arma::conv_to<arma::fmat>::from(X);
+  } else if (_storage == 2) {
+    quantize(X);
+  }
+}
+
+void Dataset::prefetch(const arma::uword& feature) const {
+  // Input: feature
+  // Output: none
+  // Process: data file of the storage 0: start reading the column of the feature, the call does not wait for it
+  if (_columns != nullptr && _storage == 0) {
+    _columns->prefetch(feature);
+  }
+}
+
+void Dataset::quantize(const arma::mat& X) {
+  // Input: data
+  // Output: none
+  // Process: code every column by at most 65535 quantiles, the codes keep the order of the values
+
+  const arma::uword maxCodes = missingCode;
+  _codes.set_size(_numRows, _numCols);
+  _codeValues.assign(_numCols, arma::vec());
+  std::vector<double> values;
+  for (arma::uword feature = 0; feature < _numCols; ++feature) {
+    if (_columns != nullptr && feature + 1 < _numCols) {
+      _columns->prefetch(feature + 1); // the next column of a data file is read while this one is coded
+    }
+    const double* column = X.colptr(feature);
+    values.clear();
+    for (arma::uword row = 0; row < _numRows; ++row) {
+      if (!std::isnan(column[row])) {
+        values.push_back(column[row]);
+      }
+    }
+    std::sort(values.begin(), values.end());
+    _codeValues[feature] = arma::vec(quantiles(values, maxCodes));
+    std::uint16_t* codeColumn = _codes.colptr(feature);
+    for (arma::uword row = 0; row < _numRows; ++row) {
+      codeColumn[row] = code(feature, column[row]);
+    }
+  }
+}
+
+std::vector<double> Dataset::quantiles(const std::vector<double>& values, const arma::uword& maxQuantiles) const {
+  // Input: sorted values of a column without the missing ones, maximum number of quantiles
+  // Output: largest value of every quantile
+  // Process: a column with few distinct values gets one quantile per value, otherwise every quantile is closed
+  // at a data value once it holds its share of the rows, so that the largest values are valid splitting values
+
+  const double rowsPerQuantile = (double)_numRows / (double)maxQuantiles;
+  std::vector<double> edges(values);
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+  if (edges.size() > maxQuantiles) {
+    edges.clear();
+    for (std::size_t i = 0; i < values.size(); ++i) {
+      if (i + 1 < values.size() && values[i] == values[i + 1]) {
+        continue;
+      }
+      if (i + 1 == values.size() || (double)(i + 1) >= rowsPerQuantile * (double)(edges.size() + 1)) {
+        edges.push_back(values[i]);
+      }
+    }
+  }
+  if (edges.empty()) {
+    edges.push_back(0.0); // column without values: a single quantile
+  }
+  return edges;
+}
+
+void Dataset::presort() {
+  // Input: none
+  // Output: none
+  // Process: sort every column of the data once, missing values last
+
+  _sortedRows.set_size(_numRows, _numCols);
+  for (arma::uword feature = 0; feature < _numCols; ++feature) {
+    if (feature + 1 < _numCols) {
+      prefetch(feature + 1); // the next column of a data file is read while this one is sorted
+    }
+    arma::uword* rows = _sortedRows.colptr(feature);
+    for (arma::uword row = 0; row < _numRows; ++row) {
+      rows[row] = row;
+    }
+    sortRows(feature, rows, _numRows);
+  }
+}
+
+void Dataset::sortRows(const arma::uword& feature, arma::uword* rows, const arma::uword& size) const {
+  // Input: feature, rows of the data (a row may appear several times), number of rows
+  // Output: none, the rows are sorted by the feature in the order of the presorted columns
+  if (_storage == 1) {
+    sortColumn(_Xf.colptr(feature), rows, size);
+  } else if (_storage == 2) {
+    sortColumn(_codes.colptr(feature), rows, size);
+  } else {
+    sortColumn(_X.colptr(feature), rows, size);
+  }
+}
+
+template <typename T>
+void Dataset::sortColumn(const T* column, arma::uword* rows, const arma::uword& size) const {
+  // Input: stored column, rows of the data, number of rows
+  // Output: none, the rows are sorted by the column, missing values last and equal values by row, so that any
+  // subset of the rows is sorted in the order of the presorted column
+  std::sort(rows, rows + size, [column](const arma::uword& a, const arma::uword& b) {
+    if (column[a] < column[b] || (isMissing(column[b]) && !isMissing(column[a]))) {
+      return true;
+    }
+    if (column[b] < column[a] || (isMissing(column[a]) && !isMissing(column[b]))) {
+      return false;
+    }
+    return a < b;
+  });
+}
+
+void Dataset::buildBins() {
+  // Input: none
+  // Output: none
+  // Process: quantize every column into at most 255 quantile bins
+
+  const arma::uword maxBins = 255;
+  _bins.set_size(_numRows, _numCols);
+  _binEdges.assign(_numCols, arma::vec());
+  _binOffset.assign(_numCols + 1, 0);
+
+  // the bins are built on the values seen by the splits, i.e. on the thresholds of the stored values
+  std::vector<double> column(_numRows), values;
+  for (arma::uword feature = 0; feature < _numCols; ++feature) {
+    if (feature + 1 < _numCols) {
+      prefetch(feature + 1); // the next column of a data file is read while this one is binned
+    }
+    values.clear();
+    for (arma::uword row = 0; row < _numRows; ++row) {
+      column[row] = value(row, feature);
+      if (!std::isnan(column[row])) {
+        values.push_back(column[row]);
+      }
+    }
+    std::sort(values.begin(), values.end());
+    std::vector<double> edges = quantiles(values, maxBins);
+    _binEdges[feature] = arma::vec(edges);
+    _binOffset[feature + 1] = _binOffset[feature] + edges.size();
+
+    // bin of a value: first bin whose edge is not below the value
+    // missing values go to the last bin, i.e. to the right of every split, as in predict()
+    unsigned char* binColumn = _bins.colptr(feature);
+    for (arma::uword row = 0; row < _numRows; ++row) {
+      if (std::isnan(column[row])) {
+        binColumn[row] = (unsigned char)(edges.size() - 1);
+      } else {
+        binColumn[row] = (unsigned char)(std::lower_bound(edges.begin(), edges.end(), column[row]) - edges.begin());
+      }
+    }
+  }
+}
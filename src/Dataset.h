@@ -0,0 +1,126 @@
+#ifndef Dataset_H
+#define Dataset_H
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <string>
+#include "CartArmadillo.h"
+#include "ColumnFile.h"
+
+//' @name Dataset
+//' @title Training data preprocessed once for many trainings
+//' @description A Dataset holds the data of many trainings, e.g. of a cross-validation or of a hyperparameter
+//' search, in the form used by the trees: the labels are encoded once, and the columns are sorted (splitMethod = 1)
+//' OR binned (splitMethod = 2) by the first training which needs them and kept for the next ones. A double matrix
+//' is used in place, without copy, and stays alive as long as the dataset. A tree trains on all the rows of the
+//' dataset, on a subset of them or on weighted rows, so that a fold or a bootstrap sample costs no preprocessing.
+//' The trees trained on a dataset use its storage, their featureStorage property is not used.
+//' @field new Constructor of the class. \itemize{
+//' \item Parameter: X - data matrix, dense or sparse (dgCMatrix). Integer matrices are converted to double once
+//' \item Parameter: Y - vector of labels
+//' \item Parameter: treeType - 0 for the classification trees and 1 for the regression trees
+//' \item Parameter: storage - (optional) storage of dense data, 0 (default) reads the double matrix in place, 1
+//' keeps a float32 copy and 2 keeps uint16 codes of at most 65535 quantiles of every feature (see the featureStorage
+//' property of Tree)
+//' }
+//' @field prepare Preprocess the data for a split method ahead of the trainings, which otherwise do it when they
+//' need it. \itemize{
+//' \item Parameter: splitMethod - 1 to sort every feature OR 2 to bin every feature (0 needs no preprocessing)
+//' }
+//' @field numRows Number of rows of the data
+//' @field numCols Number of features of the data
+//' @examples
+//' X = matrix(rnorm(4000), ncol = 4)
+//' Y = as.numeric(X[, 1] + X[, 2] > 0)
+//' ds = new(Dataset, X, Y, treeType = 0)
+//' tr = new(Tree, ident = 0, treeType = 0, maxNumFeatures = 4,
+//' numFeatures = 2, maxDepth = 6, minCount = 2, splitMethod = 2)
+//' # 5-fold cross-validation, the data is binned once
+//' folds = sample(rep(1:5, length.out = nrow(X)))
+//' errors = sapply(1:5, function(k) {
+//'   tr$train(ds, which(folds != k))
+//'   mean(tr$predict(X[folds == k, ]) != Y[folds == k])
+//' })
+//' # Bootstrap sample given as the number of draws of every row
+//' tr$train(ds, 1:nrow(X), tabulate(sample(nrow(X), replace = TRUE), nrow(X)))
+
+// Training data together with its preprocessed forms: encoded labels, presorted columns and bins.
+// The preprocessing is done once and shared (read only) by all the trees trained on the data.
+// Sparse data is kept row by row (the transpose of the CSC matrix), so that the nonzeros of the rows of a node are
+// gathered without reading the zeros.
+// Dense data is stored as the double matrix of the caller (storage 0), as a float32 copy (storage 1) OR as uint16
+// codes of at most 65535 quantiles per column (storage 2). A stored value stands for the largest double it
+// represents (its threshold), so that the splits learned on the stored data send the double data the same way.
+// Dense data may also be read in place from the memory-mapped columns of a data file (storage 0), which the
+// training only reads at the rows and the features of its nodes.
+class Dataset {
+public:
+  // methods
+  Dataset(const arma::mat& X, const arma::colvec& Y, const int& treeType);
+  Dataset(const arma::mat& X, const arma::colvec& Y, const int& treeType, const int& storage);
+  Dataset(const arma::sp_mat& X, const arma::colvec& Y, const int& treeType);
+  Dataset(const std::string& path, const int& treeType, const int& storage);
+  Dataset(const Dataset&) = delete;
+  Dataset& operator=(const Dataset&) = delete;
+  void setLabels(const arma::colvec& Y);
+  void prepare(const int& splitMethod);
+  double value(const arma::uword& row, const arma::uword& feature) const;
+  double threshold(const arma::uword& feature, const double& value) const { return value; }
+  double threshold(const arma::uword& feature, const float& value) const;
+  double threshold(const arma::uword& feature, const std::uint16_t& code) const { return _codeValues[feature](code); }
+  std::uint16_t code(const arma::uword& feature, const double& value) const;
+  void prefetch(const arma::uword& feature) const;
+  void sortRows(const arma::uword& feature, arma::uword* rows, const arma::uword& size) const;
+  static double sparseValue(const arma::sp_mat& rowMajor, const arma::uword& row, const arma::uword& feature);
+
+  static const std::uint16_t missingCode = 65535; // storage 2: code of the missing values, after all the others
+
+protected:
+  void store(const arma::mat& X);
+  void quantize(const arma::mat& X);
+  void presort();
+  template <typename T>
+  void sortColumn(const T* column, arma::uword* rows, const arma::uword& size) const;
+  void buildBins();
+  std::vector<double> quantiles(const std::vector<double>& values, const arma::uword& maxQuantiles) const;
+
+public:
+  // fields
+  std::shared_ptr<const void> _owner; // owner of the memory shared by _X when the dataset keeps it alive (R matrix)
+  std::unique_ptr<const ColumnFile> _columns; // data file: mapped columns of the data, before _X which uses them
+  const arma::mat _X; // dense data (storage 0), shares the memory of the matrix given to the constructor
+  int _storage = 0; // storage of dense data 0: double OR 1: float32 OR 2: uint16 codes
+  arma::fmat _Xf; // storage 1: data in single precision
+  arma::Mat<std::uint16_t> _codes; // storage 2: code of every value of the data
+  std::vector<arma::vec> _codeValues; // storage 2: largest value of every code of every feature
+  arma::sp_mat _rowMajor; // sparse data: one column per row of the data
+  bool _sparse = false; // the data is sparse
+  arma::uword _numRows; // rows of the data
+  arma::uword _numCols; // features of the data
+  arma::colvec _Y; // labels
+  int _treeType; // treeType 0: classification OR 1: regression
+  arma::uvec _labelCodes; // classification: classes of the data encoded as 0..K-1
+  arma::vec _classValues; // classification: class of every code
+  double _labelShift = 0.0; // regression: mean of the labels
+  arma::umat _sortedRows; // presorted mode: rows of the data sorted by each feature (one column per feature)
+  arma::Mat<unsigned char> _bins; // histogram mode: bin of every value of the data
+  std::vector<arma::vec> _binEdges; // histogram mode: largest value of every bin of every feature
+  std::vector<arma::uword> _binOffset; // histogram mode: index of the first bin of every feature in the histograms
+};
+
+// A missing value is sorted after all the other values of its column and never splits them
+inline bool isMissing(const double& value) {
+  return std::isnan(value);
+}
+
+inline bool isMissing(const float& value) {
+  return std::isnan(value);
+}
+
+inline bool isMissing(const std::uint16_t& code) {
+  return code == Dataset::missingCode;
+}
+
+#endif
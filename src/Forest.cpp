@@ -0,0 +1,275 @@
+//  Forest.cpp
+// Retrieve the definition of our Forest class
+#include "Forest.h"
+
+// Constructors
+Forest::Forest(const int& numTrees, const int& treeType, const arma::uword& maxNumFeatures,
+               const arma::uword& numFeatures, const int& maxDepth, const int& minCount):
+  Forest(numTrees, treeType, maxNumFeatures, numFeatures, maxDepth, minCount, 0) {}
+
+Forest::Forest(const int& numTrees, const int& treeType, const arma::uword& maxNumFeatures,
+               const arma::uword& numFeatures, const int& maxDepth, const int& minCount,
+               const int& splitMethod):
+  _numTrees(numTrees),
+  _treeType(treeType),
+  _maxNumFeatures(maxNumFeatures),
+  _numFeatures(numFeatures),
+  _maxDepth(maxDepth),
+  _minCount(minCount),
+  _splitMethod(splitMethod) {
+  // Input checks
+  if (_numTrees <= 0) {
+    throw std::range_error("Number of trees should be > 0");
+  }
+  // the parameters of the trees are checked by the Tree constructor
+  Tree(0, _treeType, _maxNumFeatures, _numFeatures, _maxDepth, _minCount, _splitMethod);
+}
+
+// Methods
+int Forest::getNumThreads() const {
+  return _numThreads;
+}
+
+void Forest::setNumThreads(int numThreads) {
+  if (numThreads <= 0) {
+    throw std::range_error("Number of threads should be > 0");
+  }
+  _numThreads = numThreads;
+}
+
+int Forest::getFeatureStorage() const {
+  return _featureStorage;
+}
+
+void Forest::setFeatureStorage(int featureStorage) {
+  if (featureStorage < 0 || featureStorage > 2) {
+    throw std::range_error("Feature storage should be 0 (double), 1 (float32) or 2 (uint16 codes)");
+  }
+  _featureStorage = featureStorage;
+}
+
+double Forest::getOobError() const {
+  return _oobError;
+}
+
+void Forest::train(const arma::mat &X, const arma::colvec &Y) {
+  // Input(explicit): data
+  // Output: none
+  // Process: train every tree on a bootstrap sample of the data
+
+  // Input checks
+  if (X.n_cols != _maxNumFeatures) {
+    throw std::range_error("Dataset should have number of features = max number of features");
+  }
+  if (X.n_rows <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+  if (Y.n_elem != X.n_rows) {
+    throw std::range_error("Mismatch between dimensions of X and Y");
+  }
+
+  // the data is sorted or quantized once for all the trees
+  Dataset data(X, Y, _treeType, _featureStorage);
+  fit(data);
+}
+
+void Forest::train(const std::string& path) {
+  // Input(explicit): path of a data file written by writeColumns() or csvToColumns()
+  // Output: none
+  // Process: train every tree on the memory-mapped columns of the file, which are not loaded in memory
+
+  Dataset data(path, _treeType, _featureStorage);
+  if (data._numCols != _maxNumFeatures) {
+    throw std::range_error("Dataset should have number of features = max number of features");
+  }
+  fit(data);
+}
+
+void Forest::fit(Dataset& data) {
+  // Input: data
+  // Output: none
+  // Process: train every tree on a bootstrap sample of the data, the trees are shared between the threads
+
+  data.prepare(_splitMethod);
+  _classValues = data._classValues;
+
+  // the streams of the trees are derived from a single draw of R's RNG, which is not thread safe
+  const std::uint64_t seed = Tree::drawSeed();
+  _trees.clear();
+  for (int t = 0; t < _numTrees; ++t) {
+    _trees.push_back(Tree(t, _treeType, _maxNumFeatures, _numFeatures, _maxDepth, _minCount, _splitMethod));
+  }
+
+  // out-of-bag statistics (one column per data point): votes of every class (classification)
+  // OR sum and count of the predictions (regression)
+  arma::mat oobStats((_treeType == 0) ? _classValues.n_elem : 2, data._numRows, arma::fill::zeros);
+#ifdef _OPENMP
+#pragma omp parallel num_threads(_numThreads)
+#endif
+  {
+    std::vector<char> inBag(data._numRows);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (int t = 0; t < _numTrees; ++t) {
+      std::uint64_t treeSeed = RandomStream::derive(seed, (std::uint64_t)t);
+      arma::uvec rows = bootstrap(treeSeed, data._numRows, inBag);
+      _trees[t].train(data, rows, treeSeed);
+      addOutOfBag(_trees[t], data, inBag, oobStats.memptr());
+    }
+  }
+  _oobError = outOfBagError(data, oobStats);
+}
+
+arma::uvec Forest::bootstrap(const std::uint64_t& seed, const arma::uword& numRows, std::vector<char>& inBag) const {
+  // Input: seed of the tree, number of rows of the data, buffer of numRows flags
+  // Output: rows of the bootstrap sample in increasing order, inBag flags the rows drawn at least once
+  // Process: draw numRows rows with replacement from the stream of the tree
+
+  // the root of the tree uses the streams 1 and 2 for its children, the sample uses the stream 0
+  RandomStream stream(RandomStream::derive(seed, 0));
+  std::vector<arma::uword> counts(numRows, 0);
+  for (arma::uword i = 0; i < numRows; ++i) {
+    ++counts[stream.below(numRows)];
+  }
+  arma::uvec rows(numRows);
+  arma::uword next = 0;
+  for (arma::uword row = 0; row < numRows; ++row) {
+    inBag[row] = counts[row] > 0;
+    for (arma::uword k = 0; k < counts[row]; ++k) {
+      rows(next++) = row;
+    }
+  }
+  return rows;
+}
+
+void Forest::addOutOfBag(const Tree& tree, const Dataset& data, const std::vector<char>& inBag,
+                         double* oobStats) const {
+  // Input: trained tree, data, rows drawn by the tree, out-of-bag statistics
+  // Output: none
+  // Process: add the predictions of the tree for the rows it did not draw, the trees update the statistics concurrently
+
+  const arma::uword numStats = (_treeType == 0) ? _classValues.n_elem : 2;
+  for (arma::uword row = 0; row < data._numRows; ++row) {
+    if (inBag[row]) {
+      continue;
+    }
+    double value = tree.predictRow(data, row);
+    double* stats = oobStats + row * numStats;
+    if (_treeType == 0) {
+      double* vote = stats + classCode(value);
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+      *vote += 1.0;
+    } else {
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+      stats[0] += value;
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+      stats[1] += 1.0;
+    }
+  }
+}
+
+double Forest::outOfBagError(const Dataset& data, const arma::mat& oobStats) const {
+  // Input: data, out-of-bag statistics
+  // Output: misclassification rate (classification) OR MSE (regression) of the out-of-bag predictions
+
+  double error = 0.0, count = 0.0;
+  for (arma::uword row = 0; row < data._numRows; ++row) {
+    if (_treeType == 0) {
+      arma::uword best = 0;
+      for (arma::uword k = 1; k < oobStats.n_rows; ++k) {
+        best = (oobStats(k, row) > oobStats(best, row)) ? k : best;
+      }
+      if (oobStats(best, row) > 0.0) {
+        error += (best != data._labelCodes(row));
+        count += 1.0;
+      }
+    } else if (oobStats(1, row) > 0.0) {
+      double residual = oobStats(0, row) / oobStats(1, row) - data._Y(row);
+      error += residual * residual;
+      count += 1.0;
+    }
+  }
+  return (count > 0.0) ? error / count : std::numeric_limits<double>::quiet_NaN();
+}
+
+arma::uword Forest::classCode(const double& value) const {
+  // Input: class
+  // Output: index of the class in the classes of the training data
+  return std::lower_bound(_classValues.begin(), _classValues.end(), value) - _classValues.begin();
+}
+
+arma::colvec Forest::predict(const arma::mat& X) const {
+  return predict(X, 1);
+}
+
+arma::colvec Forest::predict(const arma::mat& X, const int& numThreads) const {
+  // Input checks
+  if (_trees.empty()) {
+    throw std::range_error("The forest should be trained before making predictions");
+  }
+  if (X.n_rows <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+  if (X.n_cols != _maxNumFeatures) {
+    throw std::range_error("Data set should have the number of features = max number of features");
+  }
+  if (numThreads <= 0) {
+    throw std::range_error("Number of threads should be > 0");
+  }
+
+  // vector to store predicted values
+  arma::colvec Ypred(X.n_rows);
+
+  // the rows are processed in blocks shared between the threads, every tree runs on the tile of the block
+  // while it is in cache
+  const arma::uword blockSize = _trees[0].predictBlockSize();
+  const arma::uword numBlocks = (X.n_rows + blockSize - 1) / blockSize;
+  const arma::uword numStats = (_treeType == 0) ? _classValues.n_elem : 1;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads)
+#endif
+  {
+    // per thread buffers: row-major copy of the block, current node of every row and votes OR sums of every row
+    std::vector<double> tile(blockSize * _maxNumFeatures);
+    std::vector<std::uint32_t> nodeIndex(blockSize);
+    std::vector<double> stats(blockSize * numStats);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (arma::uword block = 0; block < numBlocks; ++block) {
+      arma::uword first = block * blockSize;
+      arma::uword size = std::min(blockSize, X.n_rows - first);
+      Tree::fillTile(X, first, size, tile.data());
+      std::fill(stats.begin(), stats.end(), 0.0);
+      for (const auto& tree : _trees) {
+        tree.descendBlock(X, first, size, tile.data(), nodeIndex.data());
+        if (_treeType == 0) {
+          for (arma::uword i = 0; i < size; ++i) {
+            stats[i * numStats + classCode(tree._nodes[nodeIndex[i]]._value)] += 1.0;
+          }
+        } else {
+          for (arma::uword i = 0; i < size; ++i) {
+            stats[i] += tree._nodes[nodeIndex[i]]._value;
+          }
+        }
+      }
+      for (arma::uword i = 0; i < size; ++i) {
+        if (_treeType == 0) {
+          // majority vote, ties go to the smallest class
+          const double* votes = stats.data() + i * numStats;
+          Ypred(first + i) = _classValues(std::max_element(votes, votes + numStats) - votes);
+        } else {
+          Ypred(first + i) = stats[i] / (double)_trees.size();
+        }
+      }
+    }
+  }
+  return Ypred;
+}
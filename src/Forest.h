@@ -0,0 +1,144 @@
+//' @name Forest$new
+//' @title Constructs a new Forest object
+//' @param numTrees Number of trees in the forest
+//' @param treeType 0 for classification forest and 1 for regresssion forest
+//' @param maxNumFeatures Number of features in the data set on which the model is trained
+//' @param numFeatures Number of features selected at each split of every tree
+//' @param maxDepth The maximum depth to which the trees are grown
+//' @param minCount Minimum number of data points for a node to qualify as a leaf node
+//' @param splitMethod (optional) split method of the trees, see \code{Tree$new}. The data is sorted or quantized
+//' only once for the whole forest, the trees read the same sorted columns OR bins
+//' @examples
+//' # Create a new object of class Forest with 100 trees
+//' fr = new(Forest, numTrees = 100, treeType = 0, maxNumFeatures = 20,
+//' numFeatures = 4, maxDepth = 10, minCount = 2)
+//' # Same forest, but the splits are searched over the histograms of the features
+//' fr = new(Forest, numTrees = 100, treeType = 0, maxNumFeatures = 20,
+//' numFeatures = 4, maxDepth = 10, minCount = 2, splitMethod = 2)
+
+//' @name Forest$train
+//' @title Fits a Forest object to the given data
+//' @description Every tree is trained on its own bootstrap sample of the data. The trees which did not draw a data
+//' point vote for it when the tree is trained, which gives the out-of-bag error without a second pass over the data.
+//' @param X  Data matrix, OR the path of a data file written by \code{writeColumns} or \code{csvToColumns}
+//' (without Y), which is memory-mapped and read from the disk by the trees as they need it. As for \code{Tree$train},
+//' the data does not need to fit in memory with splitMethod = 0 and featureStorage = 0, OR with splitMethod = 2, the
+//' other combinations keep a copy as large as the data in memory
+//' @param Y  Vector of labels
+//' @examples
+//' # Define a Forest object
+//' fr = new(Forest, numTrees = 50, treeType = 0, maxNumFeatures = 4,
+//' numFeatures = 2, maxDepth = 10, minCount = 2)
+//' # Create a training set
+//' X = matrix(c(rnorm(400, 0, 2), rnorm(400, 20, 2)), nrow = 200, ncol = 4, byrow = TRUE)
+//' Y = rep(c(0, 1), each = 100)
+//' # Train the model and check the out-of-bag error
+//' fr$train(X, Y)
+//' fr$oobError
+
+//' @name Forest$predict
+//' @title Calculates predictions based on the Forest model
+//' @param X  Data matrix
+//' @param numThreads (optional) Number of threads sharing the rows of the data matrix, 1 by default
+//' @return Vector of predictions corresponding to the data: majority vote of the trees (classification) or mean of
+//' the predictions of the trees (regression).
+//' @examples
+//' # Assume a trained Forest object, fr
+//' Xtest = matrix(c(rnorm(8, 0, 2), rnorm(8, 20, 2)), nrow = 4, ncol = 4, byrow = TRUE)
+//' fr$predict(Xtest)
+//' fr$predict(Xtest, 2)
+
+#ifndef Forest_H
+#define Forest_H
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include "CartArmadillo.h"
+#include "Tree.h"
+
+//' @name Forest
+//' @title Random forest of CART models
+//' @description Random forest made of Tree models, each trained on a bootstrap sample of the data and selecting a
+//' random subset of the features at every split. The data is preprocessed once and shared by all the trees, which
+//' are trained in parallel.
+//' @field new Constructor of the class. \itemize{
+//' \item Parameter: numTrees - number of trees in the forest
+//' \item Parameter: treeType - 0 for classification forest and 1 for regresssion forest
+//' \item Parameter: maxNumFeatures - number of features in the data set on which the model is trained
+//' \item Parameter: numFeatures - number of features selected at each split of every tree
+//' \item Parameter: maxDepth - the maximum depth to which the trees are grown
+//' \item Parameter: minCount - minimum number of data points for a node to qualify as a leaf node
+//' \item Parameter: splitMethod - (optional) split method of the trees, see \code{Tree}
+//' }
+//' @field train Train the trees of the forest on bootstrap samples of the data. \itemize{
+//' \item Parameter: X - data matrix, OR path of a data file written by writeColumns or csvToColumns, see \code{Tree}
+//' for the split methods and storages which train on data larger than memory
+//' \item Parameter: Y - vector of labels (not given with a data file)
+//' }
+//' @field predict Calculate predictions based on the forest: majority vote of the trees (classification, ties go to
+//' the smallest class) or mean of the predictions of the trees (regression). \itemize{
+//' \item Parameter: X - data matrix, based on which predictions are made
+//' \item Parameter: numThreads - (optional) number of threads used for the predictions
+//' \item Returns: Y - vector of predicted values
+//' }
+//' @field numThreads Number of threads training the trees, 1 by default. The bootstrap samples and the features
+//' sampled at every split come from random streams seeded from R's RNG, so that the trained forest does not depend
+//' on the number of threads.
+//' @field featureStorage Storage of the training data shared by the trees, see \code{Tree}. 0 by default
+//' @field oobError Out-of-bag error of the trained forest: misclassification rate (classification) or mean squared
+//' error (regression) over the data points left out of at least one bootstrap sample. NaN before training.
+//' @examples
+//' X = matrix(rnorm(2000), ncol = 4)
+//' Y = as.numeric(X[, 1] + X[, 2] > 0)
+//' fr = new(Forest, numTrees = 100, treeType = 0, maxNumFeatures = 4,
+//' numFeatures = 2, maxDepth = 8, minCount = 2)
+//' fr$numThreads = 2
+//' fr$train(X, Y)
+//' fr$oobError
+//' fr$predict(X)
+class Forest {
+public:
+  // constructors
+  Forest(const int& numTrees, const int& treeType, const arma::uword& maxNumFeatures,
+         const arma::uword& numFeatures, const int& maxDepth, const int& minCount);
+  Forest(const int& numTrees, const int& treeType, const arma::uword& maxNumFeatures,
+         const arma::uword& numFeatures, const int& maxDepth, const int& minCount,
+         const int& splitMethod);
+
+  // public methods
+  void train(const arma::mat& X, const arma::colvec& Y);
+  void train(const std::string& path);
+  int getNumThreads() const;
+  void setNumThreads(int numThreads);
+  int getFeatureStorage() const;
+  void setFeatureStorage(int featureStorage);
+  double getOobError() const;
+  arma::colvec predict(const arma::mat& X) const;
+  arma::colvec predict(const arma::mat& X, const int& numThreads) const;
+
+protected:
+  // protected methods
+  void fit(Dataset& data);
+  arma::uvec bootstrap(const std::uint64_t& seed, const arma::uword& numRows, std::vector<char>& inBag) const;
+  void addOutOfBag(const Tree& tree, const Dataset& data, const std::vector<char>& inBag, double* oobStats) const;
+  double outOfBagError(const Dataset& data, const arma::mat& oobStats) const;
+  arma::uword classCode(const double& value) const;
+
+protected:
+  // protected fields
+  int _numTrees; // number of trees
+  int _treeType; // treeType 0: classification forest OR 1: regression forest
+  arma::uword _maxNumFeatures; // total features available
+  arma::uword _numFeatures; // number of features selected at each split
+  int _maxDepth; // maxDepth of the trees
+  int _minCount; // min count of points for a leaf
+  int _splitMethod = 0; // split method of the trees
+  int _numThreads = 1; // number of threads training the trees
+  int _featureStorage = 0; // storage of the training data shared by the trees
+  std::vector<Tree> _trees; // trained trees
+  arma::vec _classValues; // classification: classes of the training data
+  double _oobError = std::numeric_limits<double>::quiet_NaN(); // out-of-bag error of the trained forest
+};
+
+#endif
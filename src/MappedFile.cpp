@@ -0,0 +1,73 @@
+//  MappedFile.cpp
+// Retrieve the definition of our MappedFile class
+#include "MappedFile.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Constructors
+MappedFile::MappedFile(const std::string& path) {
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Cannot open file " + path);
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw std::runtime_error("Cannot read the size of file " + path);
+  }
+  _size = (std::size_t)info.st_size;
+  if (_size > 0) {
+    void* address = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Cannot map file " + path);
+    }
+    _data = static_cast<const unsigned char*>(address);
+    _mapped = true;
+  }
+  close(fd); // the mapping stays valid without the descriptor
+#else
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    throw std::runtime_error("Cannot open file " + path);
+  }
+  _size = (std::size_t)file.tellg();
+  _buffer.resize(_size);
+  file.seekg(0);
+  if (_size > 0 && !file.read(reinterpret_cast<char*>(_buffer.data()), (std::streamsize)_size)) {
+    throw std::runtime_error("Cannot read file " + path);
+  }
+  _data = _buffer.data();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (_mapped) {
+    munmap(const_cast<unsigned char*>(_data), _size);
+  }
+#endif
+}
+
+void MappedFile::prefetch(const std::size_t& offset, const std::size_t& length) const {
+  // Input: range of bytes of the file
+  // Output: none
+  // Process: ask the OS to read the pages of the range in the background, a hint which may be ignored
+#ifndef _WIN32
+  if (!_mapped || offset >= _size) {
+    return;
+  }
+  const std::size_t pageSize = (std::size_t)sysconf(_SC_PAGESIZE);
+  const std::size_t begin = offset - offset % pageSize; // madvise() takes page aligned addresses
+  const std::size_t end = std::min(offset + length, _size);
+  madvise(const_cast<unsigned char*>(_data) + begin, end - begin, MADV_WILLNEED);
+#endif
+}
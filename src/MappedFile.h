@@ -0,0 +1,27 @@
+#ifndef MappedFile_H
+#define MappedFile_H
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. The file is memory-mapped, so that opening it neither reads nor copies it;
+// the pages are loaded by the OS when they are first used. Without mmap (Windows) the file is read into memory.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const unsigned char* data() const { return _data; }
+  std::size_t size() const { return _size; }
+  void prefetch(const std::size_t& offset, const std::size_t& length) const;
+
+private:
+  const unsigned char* _data = nullptr;
+  std::size_t _size = 0;
+  bool _mapped = false; // the data is mapped (and not read into _buffer)
+  std::vector<unsigned char> _buffer;
+};
+
+#endif
@@ -1,185 +1,1927 @@
 //  Tree.cpp
 // Retrieve the definition of our Tree class
 #include "Tree.h"
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <queue>
+#ifdef CARTCPP_STANDALONE
+#include <random>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Nodes holding less data points are built by the thread which split their parent
+static const arma::uword taskMinRows = 2048;
+// Nodes holding at least this many data points may process their features in parallel
+static const arma::uword parallelFeaturesMinRows = 16384;
+// Nodes holding at least 1/prefetchMinShare of the rows read almost every page of a column of a data file
+static const arma::uword prefetchMinShare = 128;
+// Presorted mode: nodes holding at most 1/sortedBlockShare of the rows of the root sort their rows into a block shared
+// by their subtree, the larger nodes walk the sorted columns of the dataset
+static const arma::uword sortedBlockShare = 16;
+// Trees whose bitvector form costs at most this many maskings per row predict with it by default
+static const arma::uword quickScorerMinCost = 8;
+
+// Header of the binary model file written by save(), followed by the nodes of the tree in the layout of CompactNode.
+// All the fields are little-endian, so that load() maps the nodes in place on little-endian hosts.
+struct ModelHeader {
+  char _magic[8]; // "CARTCPP" followed by 0
+  std::uint32_t _version;
+  std::int32_t _id;
+  std::int32_t _treeType;
+  std::int32_t _maxDepth;
+  std::int32_t _minCount;
+  std::int32_t _splitMethod;
+  std::uint64_t _maxNumFeatures;
+  std::uint64_t _numFeatures;
+  std::uint64_t _numNodes;
+  std::uint64_t _treeDepth;
+};
+static_assert(sizeof(ModelHeader) == 64, "The model header should take 64 bytes");
+static_assert(sizeof(CompactNode) == 16, "A node should take 16 bytes in the model file");
+static const char modelMagic[8] = {'C', 'A', 'R', 'T', 'C', 'P', 'P', 0};
+static const std::uint32_t modelVersion = 1;
+
+static bool littleEndianHost() {
+  const std::uint16_t one = 1;
+  return *reinterpret_cast<const unsigned char*>(&one) == 1;
+}
+
+template <typename T>
+static void swapBytes(T& value) {
+  unsigned char* bytes = reinterpret_cast<unsigned char*>(&value);
+  std::reverse(bytes, bytes + sizeof(T));
+}
+
+// byte order of the model file <-> byte order of a big-endian host
+static void swapBytes(ModelHeader& header) {
+  swapBytes(header._version);
+  swapBytes(header._id);
+  swapBytes(header._treeType);
+  swapBytes(header._maxDepth);
+  swapBytes(header._minCount);
+  swapBytes(header._splitMethod);
+  swapBytes(header._maxNumFeatures);
+  swapBytes(header._numFeatures);
+  swapBytes(header._numNodes);
+  swapBytes(header._treeDepth);
+}
+
+static void swapBytes(CompactNode& node) {
+  swapBytes(node._value);
+  swapBytes(node._featureIndex);
+  swapBytes(node._left);
+}
+
+// Check the nodes of a model file, so that a corrupted file raises an error instead of sending the predictions out of
+// the nodes or of the rows: the children of a node follow it in the array (which rules out cycles), the features are
+// features of the data and the depth of the header is the one of the tree. The nodes are walked depth-first from the
+// root with a stack of the depth of the tree (the nodes grown by update() are not in breadth-first order), a node
+// shared by two parents shows up as more visits than nodes.
+static void checkNodes(const CompactNode* nodes, const ModelHeader& header, const std::string& path) {
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> stack(1, std::make_pair(0, 0)); // (node, depth)
+  std::uint64_t visited = 0, treeDepth = 0;
+  while (!stack.empty()) {
+    const std::uint64_t nd = stack.back().first, depth = stack.back().second;
+    stack.pop_back();
+    const std::uint64_t left = nodes[nd]._left;
+    if (++visited > header._numNodes || nodes[nd]._featureIndex >= header._maxNumFeatures ||
+        (left != 0 && (left <= nd || left + 1 >= header._numNodes))) {
+      throw std::range_error("File " + path + " is a corrupted tree model");
+    }
+    treeDepth = std::max(treeDepth, depth);
+    if (left != 0) {
+      stack.push_back(std::make_pair(left + 1, depth + 1));
+      stack.push_back(std::make_pair(left, depth + 1));
+    }
+  }
+  if (treeDepth != header._treeDepth) {
+    throw std::range_error("File " + path + " is a corrupted tree model");
+  }
+}
+
+// Split of a tree in its bitvector form: the leaves [first, last) form its left subtree
+struct BitvectorSplit {
+  double _value;
+  std::uint32_t _featureIndex;
+  arma::uword _first;
+  arma::uword _last;
+};
+
+// Number the leaves below the node "nd" from left to right and record the leaves covered by every split
+static void numberLeaves(const NodeArray& nodes, const std::uint32_t& nd, std::vector<std::uint32_t>& leafNodes,
+                         std::vector<BitvectorSplit>& splits) {
+  if (nodes[nd]._left == 0) {
+    leafNodes.push_back(nd);
+    return;
+  }
+  BitvectorSplit split;
+  split._value = nodes[nd]._value;
+  split._featureIndex = nodes[nd]._featureIndex;
+  split._first = leafNodes.size();
+  numberLeaves(nodes, nodes[nd]._left, leafNodes, splits);
+  split._last = leafNodes.size();
+  splits.push_back(split);
+  numberLeaves(nodes, nodes[nd]._left + 1, leafNodes, splits);
+}
+
+// Index of the lowest set bit of a non zero word
+static inline arma::uword lowestBit(const std::uint64_t& word) {
+#if defined(__GNUC__)
+  return (arma::uword)__builtin_ctzll(word);
+#else
+  arma::uword bit = 0;
+  while (((word >> bit) & 1ULL) == 0) {
+    ++bit;
+  }
+  return bit;
+#endif
+}
+
+// Two consecutive values of a sorted column give a new splitting value, missing values are sorted last and never do
+template <typename T>
+static inline bool newSplitValue(const T& value, const T& next) {
+  return value != next && !isMissing(value);
+}
 
 // Constructors
 Node::Node(const arma::uword& d): _depth(d) {}
 
-Tree::Tree() {}
+Node::~Node() {
+  delete _left;
+  delete _right;
+}
+
+Tree::Tree() {}
+
+Tree::Tree(const int& ident, const int& treeType, const arma::uword& maxNumFeatures,
+           const arma::uword& numFeatures, const int& maxDepth, const int& minCount):
+  Tree(ident, treeType, maxNumFeatures, numFeatures, maxDepth, minCount, 0) {}
+
+Tree::Tree(const int& ident, const int& treeType, const arma::uword& maxNumFeatures,
+           const arma::uword& numFeatures, const int& maxDepth, const int& minCount,
+           const int& splitMethod):
+  _id(ident),
+  _treeType(treeType),
+  _maxNumFeatures(maxNumFeatures),
+  _numFeatures(numFeatures),
+  _maxDepth(maxDepth),
+  _minCount(minCount),
+  _splitMethod(splitMethod) {
+  // Input checks
+  if (_treeType < 0 || _treeType > 1) {
+    throw std::range_error("Tree type should be either 0 or 1");
+  }
+  if (_maxNumFeatures <= 0) {
+    throw std::range_error("Max number of features should be > 0");
+  }
+  if (_numFeatures <= 0) {
+    throw std::range_error("Number of features selected at each split should be > 0");
+  }
+  if (_maxNumFeatures < _numFeatures) {
+    throw std::range_error("Number of features selected at each split should be (<=) maximum number of features");
+  }
+  if (_maxDepth <= 0) {
+    throw std::range_error("Max depth > 0");
+  }
+  if (_minCount <= 0) {
+    throw std::range_error("Min count for a leaf node should be > 0");
+  }
+  if (_splitMethod < 0 || _splitMethod > 2) {
+    throw std::range_error("Split method should be 0, 1 or 2");
+  }
+}
+
+// Methods
+#ifdef CARTCPP_STANDALONE
+// Standalone library: the seeds of the trainings are drawn from a generator seeded by Tree::seedRandom()
+static std::mt19937_64 seedGenerator;
+
+void Tree::seedRandom(const std::uint64_t& seed) {
+  seedGenerator.seed(seed);
+}
+#endif
+
+std::uint64_t Tree::drawSeed() {
+  // Output: seed of the random stream of the root node drawn from R's RNG, so that set.seed() applies
+  // (standalone library: from the generator seeded by seedRandom())
+#ifdef CARTCPP_STANDALONE
+  return seedGenerator();
+#else
+  Rcpp::RNGScope rngScope;
+  std::uint64_t high = (std::uint64_t)(R::unif_rand() * 4294967296.0);
+  std::uint64_t low = (std::uint64_t)(R::unif_rand() * 4294967296.0);
+  return (high << 32) | low;
+#endif
+}
+
+int Tree::getQuickScorer() const {
+  return _quickScorer;
+}
+
+void Tree::setQuickScorer(int quickScorer) {
+  if (quickScorer < -1 || quickScorer > 1) {
+    throw std::range_error("quickScorer should be -1 (automatic), 0 (never) or 1 (whenever the depth is <= 8)");
+  }
+  _quickScorer = quickScorer;
+}
+
+int Tree::getFeatureStorage() const {
+  return _featureStorage;
+}
+
+void Tree::setFeatureStorage(int featureStorage) {
+  if (featureStorage < 0 || featureStorage > 2) {
+    throw std::range_error("Feature storage should be 0 (double), 1 (float32) or 2 (uint16 codes)");
+  }
+  _featureStorage = featureStorage;
+}
+
+bool Tree::getCollectStats() const {
+  return _collectStats;
+}
+
+void Tree::setCollectStats(bool collectStats) {
+  _collectStats = collectStats;
+}
+
+int Tree::getMaxLeaves() const {
+  return _maxLeaves;
+}
+
+void Tree::setMaxLeaves(int maxLeaves) {
+  if (maxLeaves < 0) {
+    throw std::range_error("Max number of leaves should be >= 0 (0 for no limit)");
+  }
+  _maxLeaves = maxLeaves;
+}
+
+double Tree::getMinGain() const {
+  return _minGain;
+}
+
+void Tree::setMinGain(double minGain) {
+  if (!(minGain >= 0.0)) {
+    throw std::range_error("Min gain should be >= 0");
+  }
+  _minGain = minGain;
+}
+
+int Tree::getApproxMinRows() const {
+  return _approxMinRows;
+}
+
+void Tree::setApproxMinRows(int approxMinRows) {
+  if (approxMinRows < 0) {
+    throw std::range_error("Min number of rows of the approximate search should be >= 0 (0 for the exact search)");
+  }
+  _approxMinRows = approxMinRows;
+}
+
+int Tree::getApproxSampleSize() const {
+  return _approxSampleSize;
+}
+
+void Tree::setApproxSampleSize(int approxSampleSize) {
+  if (approxSampleSize < 2) {
+    throw std::range_error("Sample size of the approximate search should be >= 2");
+  }
+  _approxSampleSize = approxSampleSize;
+}
+
+double Tree::getHoeffdingDelta() const {
+  return _hoeffdingDelta;
+}
+
+void Tree::setHoeffdingDelta(double hoeffdingDelta) {
+  if (!(hoeffdingDelta > 0.0 && hoeffdingDelta < 1.0)) {
+    throw std::range_error("Hoeffding delta should be > 0 and < 1");
+  }
+  _hoeffdingDelta = hoeffdingDelta;
+}
+
+int Tree::getGracePeriod() const {
+  return _gracePeriod;
+}
+
+void Tree::setGracePeriod(int gracePeriod) {
+  if (gracePeriod <= 0) {
+    throw std::range_error("Grace period should be > 0");
+  }
+  _gracePeriod = gracePeriod;
+}
+
+double Tree::getTieThreshold() const {
+  return _tieThreshold;
+}
+
+void Tree::setTieThreshold(double tieThreshold) {
+  if (!(tieThreshold >= 0.0)) {
+    throw std::range_error("Tie threshold should be >= 0");
+  }
+  _tieThreshold = tieThreshold;
+}
+
+std::map<std::string, double> Tree::stats() const {
+  // Input: none
+  // Output: statistics of the last training, empty unless it collected them
+  std::map<std::string, double> stats;
+  if (_stats._nodes == 0.0) {
+    return stats;
+  }
+  stats["prepareSeconds"] = _stats._prepareSeconds;
+  stats["sortSeconds"] = _stats._sortSeconds;
+  stats["scanSeconds"] = _stats._scanSeconds;
+  stats["evalSeconds"] = _stats._evalSeconds;
+  stats["partitionSeconds"] = _stats._partitionSeconds;
+  stats["leafSeconds"] = _stats._leafSeconds;
+  stats["totalSeconds"] = _stats._totalSeconds;
+  stats["candidates"] = _stats._candidates;
+  stats["bytesAllocated"] = _stats._bytesAllocated;
+  stats["nodes"] = _stats._nodes;
+  stats["maxDepth"] = _stats._maxDepth;
+  return stats;
+}
+
+int Tree::getNumThreads() const {
+  return _numThreads;
+}
+
+void Tree::setNumThreads(int numThreads) {
+  if (numThreads <= 0) {
+    throw std::range_error("Number of threads should be > 0");
+  }
+  _numThreads = numThreads;
+}
+
+void Tree::train(const arma::mat &X, const arma::colvec &Y) {
+  // Input(explicit): data
+  // Output: none
+  // Process: build a decision tree
+
+  // Input checks
+  if (X.n_cols != _maxNumFeatures) {
+    throw std::range_error("Dataset should have number of features = max number of features");
+  }
+  if (X.n_rows <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+  if (Y.n_elem != X.n_rows) {
+    throw std::range_error("Mismatch between dimensions of X and Y");
+  }
+
+  // preprocess the data for this tree only and train on all the rows
+  const auto start = std::chrono::steady_clock::now();
+  Dataset data(X, Y, _treeType, _featureStorage);
+  Tree::trainRows(data, arma::regspace<arma::uvec>(0, 1, data._numRows - 1), start);
+}
+
+void Tree::train(const arma::sp_mat &X, const arma::colvec &Y) {
+  // Input(explicit): sparse data
+  // Output: none
+  // Process: build a decision tree, the split search only reads the nonzeros of the data
+
+  // Input checks
+  if (X.n_cols != _maxNumFeatures) {
+    throw std::range_error("Dataset should have number of features = max number of features");
+  }
+  if (X.n_rows <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+  if (Y.n_elem != X.n_rows) {
+    throw std::range_error("Mismatch between dimensions of X and Y");
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  Dataset data(X, Y, _treeType);
+  Tree::trainRows(data, arma::regspace<arma::uvec>(0, 1, data._numRows - 1), start);
+}
+
+void Tree::train(const std::string& path) {
+  // Input(explicit): path of a data file written by writeColumns() or csvToColumns()
+  // Output: none
+  // Process: build a decision tree on the memory-mapped columns of the file, which are not loaded in memory
+
+  const auto start = std::chrono::steady_clock::now();
+  Dataset data(path, _treeType, _featureStorage);
+  Tree::trainRows(data, arma::regspace<arma::uvec>(0, 1, data._numRows - 1), start);
+}
+
+void Tree::train(Dataset& data) {
+  // Input(explicit): dataset kept between the trainings
+  // Output: none
+  // Process: build a decision tree on all the rows of the dataset, its preprocessing is reused
+
+  const auto start = std::chrono::steady_clock::now();
+  Tree::trainRows(data, arma::regspace<arma::uvec>(0, 1, data._numRows - 1), start);
+}
+
+void Tree::train(Dataset& data, const arma::uvec& rows) {
+  // Input(explicit): dataset kept between the trainings, rows of the training (starting with 1, possibly repeated)
+  // Output: none
+  // Process: build a decision tree on the rows of the dataset, its preprocessing is reused
+
+  const auto start = std::chrono::steady_clock::now();
+  arma::uvec dataRows(rows.n_elem);
+  for (arma::uword i = 0; i < rows.n_elem; ++i) {
+    // Input checks
+    if (rows(i) < 1 || rows(i) > data._numRows) {
+      throw std::range_error("Rows should be between 1 and the number of rows of the dataset");
+    }
+    dataRows(i) = rows(i) - 1;
+  }
+  Tree::trainRows(data, dataRows, start);
+}
+
+void Tree::train(Dataset& data, const arma::uvec& rows, const arma::vec& weights) {
+  // Input(explicit): dataset kept between the trainings, rows of the training (starting with 1), frequency weight
+  // of every row
+  // Output: none
+  // Process: repeat every row as many times as its weight and build a decision tree on the repeated rows
+
+  // Input checks
+  if (weights.n_elem != rows.n_elem) {
+    throw std::range_error("Mismatch between dimensions of rows and weights");
+  }
+  std::vector<arma::uword> repeated;
+  for (arma::uword i = 0; i < rows.n_elem; ++i) {
+    if (!(weights(i) >= 0.0) || weights(i) != std::floor(weights(i))) {
+      throw std::range_error("Weights should be whole numbers >= 0");
+    }
+    repeated.insert(repeated.end(), (std::size_t)weights(i), rows(i));
+  }
+  Tree::train(data, arma::uvec(repeated));
+}
+
+void Tree::trainRows(Dataset& data, const arma::uvec& rows, const std::chrono::steady_clock::time_point& start) {
+  // Input: data, training rows (starting with 0), time at which the training started
+  // Output: none
+  // Process: prepare the data for the split method, unless it already is, and train on the rows
+
+  data.prepare(_splitMethod);
+  const double prepareSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  Tree::train(data, rows, drawSeed());
+  if (_collectStats) {
+    _stats._prepareSeconds = prepareSeconds;
+  }
+}
+
+void Tree::train(const Dataset& data, const arma::uvec& rows, const std::uint64_t& seed) {
+  // Input: preprocessed data, training rows (a row may appear several times), seed of the random stream of the root
+  // Output: none
+  // Process: build a decision tree on the rows of the data
+
+  // Input checks
+  if (data._numCols != _maxNumFeatures) {
+    throw std::range_error("Dataset should have number of features = max number of features");
+  }
+  if (data._treeType != _treeType) {
+    throw std::range_error("Dataset should be prepared for the type of the tree");
+  }
+  if (rows.n_elem <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+  if ((_splitMethod == 1 && data._sortedRows.n_elem == 0) || (_splitMethod == 2 && data._bins.n_elem == 0)) {
+    throw std::range_error("Dataset should be prepared for the split method of the tree");
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  _stats = TrainingStats();
+  clearOnline(); // the trained tree replaces the one grown by update()
+  _data = &data;
+  std::unique_ptr<Node> root(new Node(0)); // create root node, the node graph is only alive during training
+  _rows = rows; // feed data to the root node
+  root->_begin = 0;
+  root->_end = rows.n_elem;
+  _goesLeft.assign(data._numRows, 0);
+  _workspaces.assign(_numThreads, Workspace());
+#ifdef _OPENMP
+  _parallelLevel = omp_get_level() + 1;
+#endif
+  if (_collectStats) { // the workspaces are only used inside the region building the tree
+    _stats._bytesAllocated += (double)(rows.n_elem * sizeof(arma::uword) + data._numRows + sizeof(Node));
+  }
+  // start building the tree, the threads share the subtrees as tasks
+  _rootSize = rows.n_elem;
+  root->_seed = seed;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(_numThreads)
+#pragma omp single
+#endif
+  {
+    if (_splitMethod == 2) {
+      Tree::buildHistogram(root.get(), data._Y);
+    }
+    if (_maxLeaves > 0) {
+      Tree::growBestFirst(root.get(), data._X, data._Y);
+    } else {
+      Tree::buildTree(root.get(), data._X, data._Y);
+    }
+  }
+  Tree::compile(root.get()); // flatten the tree for predict() and print()
+  if (_collectStats) {
+    for (const auto& ws : _workspaces) {
+      _stats.add(ws._stats);
+    }
+    _stats._bytesAllocated += (double)(_nodes.size() * sizeof(CompactNode));
+    _stats._nodes = (double)_nodes.size();
+    _stats._maxDepth = (double)_treeDepth;
+    _stats._totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // release the training buffers
+  _rows.reset();
+  std::vector<char>().swap(_goesLeft);
+  std::vector<Workspace>().swap(_workspaces);
+  std::vector<arma::mat>().swap(_histogramPool);
+  _data = nullptr;
+}
+
+void Tree::update(const arma::mat& X, const arma::colvec& Y) {
+  // Input(explicit): batch of data
+  // Output: none
+  // Process: send every row of the batch to its leaf and add it to the statistics of the leaf, check the split of a
+  // leaf every gracePeriod rows it sees, then copy the grown tree to the node array used by predict() and print()
+
+  // Input checks
+  if (X.n_cols != _maxNumFeatures) {
+    throw std::range_error("Dataset should have number of features = max number of features");
+  }
+  if (X.n_rows <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+  if (Y.n_elem != X.n_rows) {
+    throw std::range_error("Mismatch between dimensions of X and Y");
+  }
+  for (arma::uword row = 0; row < Y.n_elem; ++row) {
+    if (std::isnan(Y(row))) {
+      throw std::range_error("Labels should not be missing");
+    }
+  }
+  if (_onlineNodes.empty() && !_nodes.empty()) {
+    throw std::range_error("A tree trained by train or loaded by load cannot be updated");
+  }
+  if (_onlineNodes.empty()) {
+    startOnline(X, Y);
+  }
+
+  for (arma::uword row = 0; row < X.n_rows; ++row) {
+    const arma::uword code = (_treeType == 0) ? onlineCode(Y(row)) : 0;
+    const double y = Y(row) - _onlineShift;
+    // label statistics of the row: count, class counts (classification) OR count, sum, sum of squares (regression)
+    auto add = [&](double* stats) {
+      stats[0] += 1.0;
+      if (_treeType == 0) {
+        stats[1 + code] += 1.0;
+      } else {
+        stats[1] += y;
+        stats[2] += y * y;
+      }
+    };
+    std::uint32_t nd = 0;
+    while (_onlineNodes[nd]._left != 0) {
+      nd = _onlineNodes[nd]._left + !(X(row, _onlineNodes[nd]._featureIndex) <= _onlineNodes[nd]._value);
+    }
+    OnlineLeaf& leaf = _onlineLeaves[nd];
+    add(leaf._totals.memptr());
+    for (arma::uword k = 0; k < leaf._features.n_elem; ++k) {
+      // bin of the value: first bin whose edge is not below it, the missing values and the values above the edges
+      // of the first batch go to the last bin
+      const arma::vec& edges = _onlineEdges[leaf._features(k)];
+      const double value = X(row, leaf._features(k));
+      arma::uword bin = edges.n_elem - 1;
+      if (!std::isnan(value)) {
+        bin = std::min<arma::uword>(bin, std::lower_bound(edges.begin(), edges.end(), value) - edges.begin());
+      }
+      add(leaf._histogram.colptr(leaf._offsets[k] + bin));
+    }
+    leaf._pending += 1.0;
+    if (leaf._pending >= (double)_gracePeriod) {
+      splitOnline(nd);
+    }
+  }
+
+  // values of the leaves, then the nodes used by predict() and print()
+  _treeDepth = 0;
+  for (std::size_t nd = 0; nd < _onlineNodes.size(); ++nd) {
+    if (_onlineNodes[nd]._left == 0) {
+      _onlineNodes[nd]._value = onlineValue(_onlineLeaves[nd]._totals);
+    }
+    _treeDepth = std::max(_treeDepth, _onlineLeaves[nd]._depth);
+  }
+  _nodes.assign(std::vector<CompactNode>(_onlineNodes));
+  buildBitvectors();
+}
+
+void Tree::startOnline(const arma::mat& X, const arma::colvec& Y) {
+  // Input: first batch of the updates
+  // Output: none
+  // Process: the bins of the features are the quantile bins of the first batch (at most 255 per feature), its
+  // classes get the first codes and its mean centers the regression labels, the root is the only leaf
+
+  Dataset first(X, Y, _treeType);
+  first.prepare(2);
+  _onlineEdges = first._binEdges;
+  _onlineClasses.assign(first._classValues.begin(), first._classValues.end());
+  _onlineShift = first._labelShift;
+  _onlineSeed = drawSeed();
+  const arma::uword numStats = (_treeType == 0) ? _onlineClasses.size() + 1 : 3;
+  addOnlineLeaf(0, arma::vec(numStats, arma::fill::zeros));
+}
+
+void Tree::addOnlineLeaf(const arma::uword& depth, const arma::vec& totals) {
+  // Input: depth of the leaf, statistics of the rows of the parent which go to the leaf
+  // Output: none
+  // Process: append a leaf to the grown tree, with the features sampled from its random stream and empty bins
+
+  const std::uint32_t nd = (std::uint32_t)_onlineNodes.size();
+  CompactNode node;
+  node._value = 0.0;
+  node._featureIndex = 0;
+  node._left = 0;
+  OnlineLeaf leaf;
+  leaf._depth = depth;
+  leaf._features = sampleFeatures(RandomStream::derive(_onlineSeed, nd));
+  leaf._offsets.assign(1, 0);
+  for (arma::uword feature : leaf._features) {
+    leaf._offsets.push_back(leaf._offsets.back() + _onlineEdges[feature].n_elem);
+  }
+  leaf._histogram.zeros(totals.n_elem, leaf._offsets.back());
+  leaf._totals = totals;
+  _onlineNodes.push_back(node);
+  _onlineLeaves.push_back(std::move(leaf));
+}
+
+arma::uword Tree::onlineCode(const double& label) {
+  // Input: class label
+  // Output: code of the class, a new class gets the next code and a row in the statistics of every leaf
+  for (std::size_t code = 0; code < _onlineClasses.size(); ++code) {
+    if (_onlineClasses[code] == label) {
+      return code;
+    }
+  }
+  _onlineClasses.push_back(label);
+  for (auto& leaf : _onlineLeaves) {
+    if (leaf._totals.n_elem > 0) {
+      leaf._histogram.insert_rows(leaf._histogram.n_rows, 1);
+      leaf._totals.insert_rows(leaf._totals.n_elem, 1);
+    }
+  }
+  return _onlineClasses.size() - 1;
+}
+
+bool Tree::splitOnline(const std::uint32_t& nd) {
+  // Input: leaf of the grown tree
+  // Output: boolean indicating whether the leaf was split
+  // Process: find the best split of every sampled feature over the bins, split the leaf on the best one when the
+  // Hoeffding bound shows that its merit is above the merit of the second best feature (OR of no split), or that
+  // both are too close to matter. The merits (Gini gain OR share of the explained variance) range in [0, 1].
+
+  OnlineLeaf& leaf = _onlineLeaves[nd];
+  leaf._pending = 0.0;
+  const arma::uword numStats = leaf._histogram.n_rows;
+
+  // statistics of the rows seen by the leaf: sum over the bins of any feature
+  arma::vec seenStats(numStats, arma::fill::zeros), leftStats(numStats), rightStats(numStats);
+  for (arma::uword bin = 0; bin < leaf._offsets[1]; ++bin) {
+    for (arma::uword s = 0; s < numStats; ++s) {
+      seenStats(s) += leaf._histogram(s, bin);
+    }
+  }
+  const double seen = seenStats(0);
+  if (leaf._depth >= (arma::uword)_maxDepth || seen <= (double)_minCount) {
+    return false;
+  }
+  // impurity of the leaf: Gini index (classification) OR variance of the labels (regression)
+  double impurity = 0.0;
+  if (_treeType == 0) {
+    double squares = 0.0;
+    for (arma::uword s = 1; s < numStats; ++s) {
+      squares += seenStats(s) * seenStats(s);
+    }
+    impurity = 1.0 - squares / (seen * seen);
+  } else {
+    impurity = (seenStats(2) - seenStats(1) * seenStats(1) / seen) / seen;
+  }
+  if (!(impurity > 0.0)) {
+    return false; // pure leaf
+  }
+
+  double bestMerit = 0.0, secondMerit = 0.0; // merit of no split: 0
+  arma::uword bestFeature = 0, bestBin = 0;
+  bool found = false;
+  for (arma::uword k = 0; k < leaf._features.n_elem; ++k) {
+    leftStats.zeros();
+    rightStats = seenStats;
+    double featureMerit = 0.0;
+    arma::uword featureBin = 0;
+    const double* hist = leaf._histogram.colptr(leaf._offsets[k]);
+    for (arma::uword bin = 0; bin + 1 < leaf._offsets[k + 1] - leaf._offsets[k]; ++bin) {
+      const double* binStats = hist + bin * numStats;
+      if (binStats[0] == 0.0) {
+        continue; // empty bin: same split as the previous bin
+      }
+      for (arma::uword s = 0; s < numStats; ++s) {
+        leftStats(s) += binStats[s];
+        rightStats(s) -= binStats[s];
+      }
+      if (rightStats(0) == 0.0) {
+        break; // no data points left on the right side
+      }
+      double score = histogramScore(leftStats.memptr(), rightStats.memptr(), numStats - 1);
+      double merit = (_treeType == 0) ? impurity - score : 1.0 - score / impurity;
+      if (merit > featureMerit) {
+        featureMerit = merit;
+        featureBin = bin;
+      }
+    }
+    if (featureMerit > bestMerit) {
+      secondMerit = bestMerit;
+      bestMerit = featureMerit;
+      bestFeature = k;
+      bestBin = featureBin;
+      found = true;
+    } else if (featureMerit > secondMerit) {
+      secondMerit = featureMerit;
+    }
+  }
+  // Hoeffding bound of the difference of the merits after the rows seen by the leaf
+  const double epsilon = std::sqrt(std::log(1.0 / _hoeffdingDelta) / (2.0 * seen));
+  if (!found || (bestMerit - secondMerit <= epsilon && epsilon >= _tieThreshold)) {
+    return false;
+  }
+
+  // the leaf becomes a split node at the largest value of the best bin, its children start with the statistics of
+  // the rows of their side
+  const arma::uword feature = leaf._features(bestFeature);
+  arma::vec leftTotals(numStats, arma::fill::zeros);
+  const double* hist = leaf._histogram.colptr(leaf._offsets[bestFeature]);
+  for (arma::uword bin = 0; bin <= bestBin; ++bin) {
+    for (arma::uword s = 0; s < numStats; ++s) {
+      leftTotals(s) += hist[bin * numStats + s];
+    }
+  }
+  const arma::vec rightTotals = seenStats - leftTotals;
+  const arma::uword depth = leaf._depth;
+  _onlineLeaves[nd] = OnlineLeaf(); // the statistics of a split node are no longer needed
+  _onlineLeaves[nd]._depth = depth;
+  _onlineNodes[nd]._featureIndex = (std::uint32_t)feature;
+  _onlineNodes[nd]._value = _onlineEdges[feature](bestBin);
+  _onlineNodes[nd]._left = (std::uint32_t)_onlineNodes.size();
+  addOnlineLeaf(depth + 1, leftTotals);
+  addOnlineLeaf(depth + 1, rightTotals);
+  return true;
+}
+
+double Tree::onlineValue(const arma::vec& totals) const {
+  // Input: statistics of the rows of a leaf of the grown tree
+  // Output: value of the leaf: most frequent class (classification) OR mean of the labels (regression)
+  if (_treeType == 0) {
+    arma::uword best = 0;
+    for (arma::uword code = 1; code + 1 < totals.n_elem; ++code) {
+      if (totals(1 + code) > totals(1 + best)) {
+        best = code;
+      }
+    }
+    return _onlineClasses[best];
+  }
+  return _onlineShift + totals(1) / totals(0);
+}
+
+void Tree::clearOnline() {
+  // Input: none
+  // Output: none
+  // Process: forget the tree grown by update() and its statistics
+  std::vector<CompactNode>().swap(_onlineNodes);
+  std::vector<OnlineLeaf>().swap(_onlineLeaves);
+  std::vector<arma::vec>().swap(_onlineEdges);
+  std::vector<double>().swap(_onlineClasses);
+}
+
+void Tree::compile(const Node* root) {
+  // Input: root of the trained node graph
+  // Output: none
+  // Process: lay the tree out as a contiguous array of nodes in breadth-first order
+  // the children of a node are adjacent, so that a node only stores the index of its left child
+
+  std::vector<const Node*> order = {root};
+  std::vector<CompactNode> nodes;
+  _treeDepth = 0;
+  for (std::size_t i = 0; i < order.size(); ++i) {
+    const Node* nd = order[i];
+    _treeDepth = std::max(_treeDepth, nd->_depth);
+    CompactNode node;
+    if (nd->_leaf) {
+      node._value = nd->_classResult;
+      node._featureIndex = 0;
+      node._left = 0;
+    } else {
+      node._value = nd->_splitValue;
+      node._featureIndex = (std::uint32_t)nd->_featureIndex;
+      node._left = (std::uint32_t)order.size();
+      order.push_back(nd->_left);
+      order.push_back(nd->_right);
+    }
+    nodes.push_back(node);
+  }
+  nodes.shrink_to_fit();
+  _nodes.assign(std::move(nodes));
+  buildBitvectors();
+}
+
+void Tree::buildTree(Node* nd, const arma::mat &X, const arma::colvec &Y){
+  // Input: node, data
+  // Output: none
+  // Process: check if the node can be split, split the node, continue building the tree
+
+  if (Tree::stop(nd, Y)){
+    classResult(nd, Y);
+  } else{
+    if (searchSplit(nd, X, Y)) {
+      splitNode(nd, X, Y);
+      // large subtrees become tasks, which idle threads pick up
+      if (_numThreads > 1 && nd->_left->size() >= taskMinRows) {
+#ifdef _OPENMP
+#pragma omp task shared(X, Y)
+#endif
+        Tree::buildTree(nd->_left, X, Y);
+      } else {
+        Tree::buildTree(nd->_left, X, Y);
+      }
+      Tree::buildTree(nd->_right, X, Y);
+    } else {
+      classResult(nd, Y);
+    }
+  }
+  // the bin statistics and the sorted rows of a leaf are no longer needed
+  releaseNode(nd);
+}
+
+void Tree::growBestFirst(Node* root, const arma::mat &X, const arma::colvec &Y) {
+  // Input: root node, data
+  // Output: none
+  // Process: keep the nodes with a split in a queue ordered by the gain of the split, split the node with the largest
+  // gain until the tree has maxLeaves leaves, the nodes left in the queue become leaves. The split of a node is
+  // searched once, when the node enters the queue.
+
+  // largest gain first, ties go to the node which entered the queue first
+  typedef std::pair<double, std::pair<arma::uword, Node*>> QueueEntry;
+  auto lower = [](const QueueEntry& a, const QueueEntry& b) {
+    return a.first < b.first || (a.first == b.first && a.second.first > b.second.first);
+  };
+  std::priority_queue<QueueEntry, std::vector<QueueEntry>, decltype(lower)> queue(lower);
+  arma::uword entered = 0;
+  auto enqueue = [&](Node* nd) {
+    if (!stop(nd, Y) && searchSplit(nd, X, Y)) {
+      queue.push(QueueEntry(nd->_gain, std::make_pair(entered++, nd)));
+    } else {
+      classResult(nd, Y);
+      releaseNode(nd);
+    }
+  };
+
+  enqueue(root);
+  for (int leaves = 1; !queue.empty() && leaves < _maxLeaves; ++leaves) {
+    Node* nd = queue.top().second.second;
+    queue.pop();
+    splitNode(nd, X, Y);
+    enqueue(nd->_left);
+    enqueue(nd->_right);
+  }
+  for (; !queue.empty(); queue.pop()) {
+    Node* nd = queue.top().second.second;
+    classResult(nd, Y);
+    releaseNode(nd);
+  }
+}
+
+bool Tree::searchSplit(Node* nd, const arma::mat &X, const arma::colvec &Y) {
+  // Input: node, data
+  // Output: boolean indicating whether the node has a split whose gain reaches minGain
+  // Process: find the best split of the node with the split method of the tree
+  bool found = (_splitMethod == 2) ? findSplitHistogram(nd) : findSplit(nd, X, Y);
+  return found && (_minGain <= 0.0 || nd->_gain >= _minGain);
+}
+
+void Tree::splitNode(Node* nd, const arma::mat &X, const arma::colvec &Y) {
+  // Input: node with the split found by searchSplit(), data
+  // Output: none
+  // Process: send the data points of the node to its children, with their histograms in histogram mode
+  partition(nd, X);
+  if (_splitMethod == 2) {
+    splitHistograms(nd, Y);
+  }
+}
+
+Tree::Workspace& Tree::workspace() const {
+  // Input: none
+  // Output: scratch space of the calling thread
+  // Process: only called inside the region building the tree, whose thread numbers index the workspaces (a deeper
+  // nested region would reuse them)
+#ifdef _OPENMP
+  assert(omp_get_level() == _parallelLevel);
+  return _workspaces[omp_get_thread_num()];
+#else
+  return _workspaces[0];
+#endif
+}
+
+double* Tree::timer(double TrainingStats::* phase) const {
+  // Input: phase of the training
+  // Output: timer of the phase in the statistics of the calling thread, null unless the statistics are collected
+  return _collectStats ? &(workspace()._stats.*phase) : nullptr;
+}
+
+void Tree::countCandidates(const arma::uword& count) const {
+  // Input: number of thresholds scored by the calling thread
+  if (_collectStats) {
+    workspace()._stats._candidates += (double)count;
+  }
+}
+
+void Tree::countBytes(const double& bytes) const {
+  // Input: number of bytes allocated by the calling thread
+  if (_collectStats) {
+    workspace()._stats._bytesAllocated += bytes;
+  }
+}
+
+arma::uvec Tree::sampleFeatures(const std::uint64_t& seed) const {
+  // Input: seed of the random stream of the node
+  // Output: indices of the features considered for the split
+  // Process: select a random subset of numFeatures features from the random stream of the node
+
+  // partially shuffle linear space of column indices
+  // select the first numFeatures from the shuffled linear space
+  RandomStream stream(seed);
+  arma::uvec featureSubsetIndex = arma::regspace<arma::uvec>(0, 1, _maxNumFeatures - 1);
+  for (arma::uword i = 0; i < _numFeatures; ++i) {
+    std::swap(featureSubsetIndex(i), featureSubsetIndex(i + stream.below(_maxNumFeatures - i)));
+  }
+  return featureSubsetIndex.subvec(0, _numFeatures - 1);
+}
+
+bool Tree::parallelFeatures(const Node* nd) const {
+  // Input: node
+  // Output: boolean indicating whether the features of the node are processed in parallel
+  // Process: only the nodes holding a large share of the data, i.e. the nodes close to the root
+  return _numThreads > 1 && nd->size() >= parallelFeaturesMinRows &&
+    nd->size() * (arma::uword)_numThreads >= _rootSize;
+}
+
+bool Tree::findSplit(Node *nd, const arma::mat &X, const arma::colvec &Y) {
+  // Input: node, data
+  // Output: boolean indicating whether a split was found
+  // Process: find the best split among the sampled features, keep it and its gain in the node
+
+  arma::uvec featureSubsetIndex = sampleFeatures(nd->_seed);
+  if (nd->size() * prefetchMinShare >= _data->_numRows) {
+    // data file: the sampled columns are read from the disk while the first ones are scanned
+    for (const auto& feature : featureSubsetIndex) {
+      _data->prefetch(feature);
+    }
+  }
+  const NodeStats totals = nodeStats(nd, Y);
+
+  // large nodes: the thresholds are scored on a sample of the rows, drawn once for all the sampled features
+  RowSample sample;
+  const bool sampled = approximate(nd);
+  if (sampled) {
+    sample = sampleRows(nd, Y, totals);
+  }
+  // presorted mode: the nodes of a sorted block read their range of it, a small node without a block sorts its rows
+  // into the block of its subtree and the large nodes walk the sorted columns of the dataset with the multiplicity
+  // of every row in the node
+  std::vector<std::uint32_t> rowCounts;
+  if (_splitMethod == 1 && nd->_sorted == nullptr) {
+    if (nd->size() * sortedBlockShare <= _rootSize) {
+      sortBlock(nd);
+    } else if (!sampled) {
+      rowCounts = countRows(nd);
+    }
+  }
+  // sparse data: the nonzeros of the node are gathered once for all the sampled features
+  std::vector<std::pair<double, arma::uword>> nonzeros;
+  std::vector<arma::uword> offsets;
+  if (_data->_sparse && !sampled) {
+    offsets = gatherNonzeros(nd, featureSubsetIndex, nonzeros);
+  }
+  auto scan = [&](const arma::uword& i) {
+    if (sampled) {
+      return scanSample(featureSubsetIndex(i), sample, Y);
+    }
+    if (_data->_sparse) {
+      return scanNonzeros(nd, featureSubsetIndex(i), nonzeros.data() + offsets[i], offsets[i + 1] - offsets[i],
+                          Y, totals);
+    }
+    return scanFeature(nd, featureSubsetIndex(i), X, Y, totals, rowCounts.empty() ? nullptr : rowCounts.data());
+  };
+
+  // large nodes evaluate their features in parallel, each feature writes its own candidate
+  std::vector<SplitCandidate> candidates(featureSubsetIndex.n_elem);
+  if (parallelFeatures(nd)) {
+#ifdef _OPENMP
+#pragma omp taskloop grainsize(1) shared(candidates, featureSubsetIndex)
+#endif
+    for (arma::uword i = 0; i < featureSubsetIndex.n_elem; ++i) {
+      candidates[i] = scan(i);
+    }
+  } else {
+    for (arma::uword i = 0; i < featureSubsetIndex.n_elem; ++i) {
+      candidates[i] = scan(i);
+    }
+  }
+
+  // lowest score wins, ties go to the feature sampled first
+  const SplitCandidate* best = nullptr;
+  for (const auto& candidate : candidates) {
+    if (candidate._found && (best == nullptr || candidate._score < best->_score)) {
+      best = &candidate;
+    }
+  }
+  if (best == nullptr) {
+    return false;
+  }
+  nd->_featureIndex = best->_featureIndex;
+  nd->_splitValue = best->_splitValue;
+  // impurity of the node: Gini index (classification) OR variance of the labels (regression), the score of a
+  // sampled split estimates the one of the split on all the rows of the node
+  const double size = (double)nd->size();
+  const double impurity = (_treeType == 0) ? 1.0 - totals._squares / (size * size) : totals._regression.sse() / size;
+  nd->_gain = size / (double)_rootSize * (impurity - best->_score);
+  return true;
+}
+
+Tree::NodeStats Tree::nodeStats(const Node* nd, const arma::colvec &Y) const {
+  // Input: node, data
+  // Output: label statistics of all the data points of the node
+
+  PhaseTimer scanTimer(timer(&TrainingStats::_scanSeconds));
+  NodeStats totals;
+  const arma::uword* rows = _rows.memptr() + nd->_begin;
+  if (_treeType == 0) {
+    // class counts indexed by the class code and the sum of the squared counts
+    totals._classCounts.zeros(_data->_classValues.n_elem);
+    for (arma::uword i = 0; i < nd->size(); ++i) {
+      totals._classCounts(_data->_labelCodes(rows[i])) += 1.0;
+    }
+    for (arma::uword k = 0; k < _data->_classValues.n_elem; ++k) {
+      totals._squares += totals._classCounts(k) * totals._classCounts(k);
+    }
+  } else {
+    // labels are centered at the node mean, so that every threshold is scored in O(1)
+    for (arma::uword i = 0; i < nd->size(); ++i) {
+      totals._mean += Y(rows[i]);
+    }
+    totals._mean /= (double)nd->size();
+    for (arma::uword i = 0; i < nd->size(); ++i) {
+      totals._regression.add(Y(rows[i]) - totals._mean);
+    }
+  }
+  return totals;
+}
+
+bool Tree::approximate(const Node* nd) const {
+  // Input: node
+  // Output: boolean indicating whether the split of the node is searched on a sample of its rows
+  return _approxMinRows > 0 && nd->size() > (arma::uword)_approxMinRows &&
+    nd->size() > (arma::uword)_approxSampleSize;
+}
+
+Tree::RowSample Tree::sampleRows(const Node* nd, const arma::colvec &Y, const NodeStats& totals) const {
+  // Input: node, data, label statistics of the node
+  // Output: sample of about approxSampleSize rows of the node, with their weights and label statistics
+  // Process: classification: stratified sample, every class keeps its share of the sample and its rows weigh
+  // count / sampled rows of the class, so that the weighted class counts are the ones of the node
+  // regression: gradient-based one-side sampling, the half of the sample with the largest residuals from the node
+  // mean weighs 1 and the other half is drawn at random among the other rows, which it stands for
+
+  PhaseTimer scanTimer(timer(&TrainingStats::_scanSeconds));
+  RandomStream stream(RandomStream::derive(nd->_seed, 3)); // streams 1 and 2 seed the children
+  const arma::uword nodeSize = nd->size(), sampleSize = (arma::uword)_approxSampleSize;
+  const arma::uword* nodeRows = _rows.memptr() + nd->_begin;
+  RowSample sample;
+  sample._rows.reserve(sampleSize + _data->_classValues.n_elem);
+  sample._weights.reserve(sampleSize + _data->_classValues.n_elem);
+  // draw "count" of the "size" rows at random without replacement: partial Fisher-Yates shuffle
+  auto draw = [&](arma::uword* rows, const arma::uword& size, const arma::uword& count) {
+    const double weight = (double)size / (double)count;
+    for (arma::uword i = 0; i < count; ++i) {
+      std::swap(rows[i], rows[i + stream.below(size - i)]);
+      sample._rows.push_back(rows[i]);
+      sample._weights.push_back(weight);
+    }
+  };
+  std::vector<arma::uword> rows(nodeSize);
+  if (_treeType == 0) {
+    // rows of the node grouped by class code (counting sort), then every class is sampled in proportion
+    const arma::uword numClasses = _data->_classValues.n_elem;
+    std::vector<arma::uword> starts(numClasses + 1, 0);
+    for (arma::uword k = 0; k < numClasses; ++k) {
+      starts[k + 1] = starts[k] + (arma::uword)totals._classCounts(k);
+    }
+    std::vector<arma::uword> next(starts.begin(), starts.end() - 1);
+    for (arma::uword i = 0; i < nodeSize; ++i) {
+      rows[next[_data->_labelCodes(nodeRows[i])]++] = nodeRows[i];
+    }
+    for (arma::uword k = 0; k < numClasses; ++k) {
+      const arma::uword count = starts[k + 1] - starts[k];
+      if (count > 0) {
+        // every class of the node keeps at least one row
+        arma::uword share = (arma::uword)std::llround((double)count * (double)sampleSize / (double)nodeSize);
+        draw(rows.data() + starts[k], count, std::min(count, std::max<arma::uword>(share, 1)));
+      }
+    }
+  } else {
+    // rows ordered by decreasing absolute residual up to the top half of the sample
+    std::vector<std::pair<double, arma::uword>> residuals(nodeSize);
+    for (arma::uword i = 0; i < nodeSize; ++i) {
+      residuals[i] = std::make_pair(std::fabs(Y(nodeRows[i]) - totals._mean), nodeRows[i]);
+    }
+    const arma::uword top = sampleSize / 2;
+    std::nth_element(residuals.begin(), residuals.begin() + top, residuals.end(),
+                     std::greater<std::pair<double, arma::uword>>());
+    for (arma::uword i = 0; i < nodeSize; ++i) {
+      rows[i] = residuals[i].second;
+    }
+    sample._rows.assign(rows.begin(), rows.begin() + top);
+    sample._weights.assign(top, 1.0);
+    draw(rows.data() + top, nodeSize - top, sampleSize - top);
+  }
+
+  // weighted label statistics of the sample, regression labels centered at the node mean
+  if (_treeType == 0) {
+    sample._totals._classCounts.zeros(_data->_classValues.n_elem);
+    for (arma::uword i = 0; i < sample._rows.size(); ++i) {
+      sample._totals._classCounts(_data->_labelCodes(sample._rows[i])) += sample._weights[i];
+    }
+    for (arma::uword k = 0; k < _data->_classValues.n_elem; ++k) {
+      sample._totals._squares += sample._totals._classCounts(k) * sample._totals._classCounts(k);
+    }
+  } else {
+    sample._totals._mean = totals._mean;
+    for (arma::uword i = 0; i < sample._rows.size(); ++i) {
+      sample._totals._regression.add(Y(sample._rows[i]) - totals._mean, sample._weights[i]);
+    }
+  }
+  return sample;
+}
+
+Tree::SplitCandidate Tree::scanSample(const arma::uword& feature, const RowSample& sample,
+                                      const arma::colvec &Y) const {
+  // Input: feature, sample of the rows of a node, data
+  // Output: best split of the node along the feature, scored on the sample
+  // Process: same sweep as scanColumn() on the sampled rows in the sorted order of the feature, every row moves its
+  // weight from the right to the left side of the split
+
+  SplitCandidate best;
+  best._featureIndex = feature;
+  const arma::uword sampleSize = sample._rows.size();
+  Workspace& ws = workspace();
+  // (value, position in the sample) pairs, the values are the ones seen by the splits and the missing ones go last
+  std::vector<std::pair<double, arma::uword>>& values = ws._sortBuffer;
+  if (values.size() < sampleSize) {
+    countBytes((double)((sampleSize - values.size()) * sizeof(values[0])));
+    values.resize(sampleSize);
+  }
+  arma::uword numValues = 0, numMissing = 0;
+  {
+    PhaseTimer scanTimer(timer(&TrainingStats::_scanSeconds));
+    for (arma::uword i = 0; i < sampleSize; ++i) {
+      double value = _data->value(sample._rows[i], feature);
+      if (isMissing(value)) {
+        values[sampleSize - ++numMissing] = std::make_pair(value, i);
+      } else {
+        values[numValues++] = std::make_pair(value, i);
+      }
+    }
+  }
+  {
+    PhaseTimer sortTimer(timer(&TrainingStats::_sortSeconds));
+    std::sort(values.begin(), values.begin() + numValues);
+  }
+
+  PhaseTimer evalTimer(timer(&TrainingStats::_evalSeconds));
+  arma::uword evaluated = 0; // thresholds scored
+  const NodeStats& totals = sample._totals;
+  double leftSize = 0.0, totalSize = 0.0; // weighted sizes of the left side and of the node
+  for (const auto& weight : sample._weights) {
+    totalSize += weight;
+  }
+
+  // type: classification tree
+  if (_treeType == 0) {
+    std::vector<double>& countsLeft = ws._countsLeft;
+    std::vector<double>& countsRight = ws._countsRight;
+    countsLeft.assign(_data->_classValues.n_elem, 0.0);
+    countsRight.assign(totals._classCounts.begin(), totals._classCounts.end());
+    double squaresLeft = 0.0, squaresRight = totals._squares;
+    for (arma::uword splitIndex = 0; splitIndex < sampleSize - 1; ++splitIndex) {
+      const arma::uword i = values[splitIndex].second;
+      const arma::uword code = _data->_labelCodes(sample._rows[i]);
+      const double weight = sample._weights[i];
+      squaresLeft += (2.0 * countsLeft[code] + weight) * weight;
+      squaresRight -= (2.0 * countsRight[code] - weight) * weight;
+      countsLeft[code] += weight;
+      countsRight[code] -= weight;
+      leftSize += weight;
+
+      if (newSplitValue(values[splitIndex].first, values[splitIndex + 1].first)) {
+        ++evaluated;
+        double rightSize = totalSize - leftSize;
+        double score = (1.0 - squaresLeft / (leftSize * leftSize)) * (leftSize / totalSize) +
+          (1.0 - squaresRight / (rightSize * rightSize)) * (rightSize / totalSize);
+        if (score < best._score) {
+          best._score = score;
+          best._splitValue = values[splitIndex].first;
+          best._found = true;
+        }
+      }
+    }
+  }
+  // type: regression tree
+  else {
+    RegressionStats statsLeft, statsRight(totals._regression);
+    for (arma::uword splitIndex = 0; splitIndex < sampleSize - 1; ++splitIndex) {
+      const arma::uword i = values[splitIndex].second;
+      double y = Y(sample._rows[i]) - totals._mean;
+      statsLeft.add(y, sample._weights[i]);
+      statsRight.remove(y, sample._weights[i]);
+
+      if (newSplitValue(values[splitIndex].first, values[splitIndex + 1].first)) {
+        ++evaluated;
+        double score = (statsLeft.sse() + statsRight.sse()) / totalSize;
+        if (score < best._score) {
+          best._score = score;
+          best._splitValue = values[splitIndex].first;
+          best._found = true;
+        }
+      }
+    }
+  }
+  countCandidates(evaluated);
+  return best;
+}
+
+Tree::SplitCandidate Tree::scanFeature(const Node* nd, const arma::uword& feature, const arma::mat &X, const arma::colvec &Y,
+                                       const NodeStats& totals, const std::uint32_t* rowCounts) const {
+  // Input: node, feature, data, label statistics of the node, presorted mode: multiplicity of every data row in a
+  // node without a sorted block (null otherwise)
+  // Output: best split of the node along the feature
+  // Process: scan the column of the feature in the storage of the data
+  if (_data->_storage == 1) {
+    return scanColumn(nd, feature, _data->_Xf.colptr(feature), Y, totals, rowCounts);
+  }
+  if (_data->_storage == 2) {
+    return scanColumn(nd, feature, _data->_codes.colptr(feature), Y, totals, rowCounts);
+  }
+  return scanColumn(nd, feature, X.colptr(feature), Y, totals, rowCounts);
+}
+
+template <typename T>
+Tree::SplitCandidate Tree::scanColumn(const Node* nd, const arma::uword& feature, const T* column,
+                                      const arma::colvec &Y, const NodeStats& totals,
+                                      const std::uint32_t* rowCounts) const {
+  // Input: node, feature, stored column of the feature, data, label statistics of the node, presorted mode:
+  // multiplicity of every data row in a node without a sorted block (null otherwise)
+  // Output: best split of the node along the feature
+  // Process: sweep the rows of the node in the sorted order of the feature, moving one data point at a time
+  // from the right to the left side of the split
+
+  SplitCandidate best;
+  best._featureIndex = feature;
+
+  // Example below explains how we want to sort the values within column
+  // 3 1 2 5 - sub-column values
+  // 4 5 6 7 - rows of the node
+  // 5 6 4 7 - rows of the node in the sorted order
+  // missing values are placed after all the other values, so that they always go to the right side
+  const arma::uword nodeSize = nd->size();
+  Workspace& ws = workspace();
+  const arma::uword* rows; // rows of the node sorted by the feature
+  if (_splitMethod == 1 && rowCounts == nullptr) {
+    // presorted: the range of the node in the sorted block of its subtree is kept in the sorted order of every feature
+    rows = nd->_sorted->_rows.colptr(feature) + (nd->_begin - nd->_sorted->_begin);
+  } else if (_splitMethod == 1) {
+    // presorted, large node: the rows of the node in the sorted column of the dataset
+    if (ws._rowBuffer.size() < nodeSize) {
+      countBytes((double)((nodeSize - ws._rowBuffer.size()) * sizeof(arma::uword)));
+      ws._rowBuffer.resize(nodeSize);
+    }
+    PhaseTimer scanTimer(timer(&TrainingStats::_scanSeconds));
+    walkSorted(feature, rowCounts, ws._rowBuffer.data());
+    rows = ws._rowBuffer.data();
+  } else {
+    // exact: sort the (value, row) pairs of the node in the scratch space of the thread
+    const arma::uword* nodeRows = _rows.memptr() + nd->_begin;
+    if (ws._sortBuffer.size() < nodeSize) {
+      countBytes((double)((nodeSize - ws._sortBuffer.size()) * sizeof(ws._sortBuffer[0]) +
+                          (nodeSize - ws._rowBuffer.size()) * sizeof(arma::uword)));
+      ws._sortBuffer.resize(nodeSize);
+      ws._rowBuffer.resize(nodeSize);
+    }
+    arma::uword numValues = 0, numMissing = 0;
+    {
+      PhaseTimer scanTimer(timer(&TrainingStats::_scanSeconds));
+      for (arma::uword i = 0; i < nodeSize; ++i) {
+        const T& value = column[nodeRows[i]];
+        if (isMissing(value)) {
+          ws._sortBuffer[nodeSize - ++numMissing] = std::make_pair((double)value, nodeRows[i]);
+        } else {
+          ws._sortBuffer[numValues++] = std::make_pair((double)value, nodeRows[i]);
+        }
+      }
+    }
+    PhaseTimer sortTimer(timer(&TrainingStats::_sortSeconds));
+    std::sort(ws._sortBuffer.begin(), ws._sortBuffer.begin() + numValues);
+    for (arma::uword i = 0; i < nodeSize; ++i) {
+      ws._rowBuffer[i] = ws._sortBuffer[i].second;
+    }
+    rows = ws._rowBuffer.data();
+  }
+
+  PhaseTimer evalTimer(timer(&TrainingStats::_evalSeconds));
+  arma::uword evaluated = 0; // thresholds scored
+
+  // type: classification tree
+  if (_treeType == 0) {
+    // class counts of both sides of the split together with the sums of the squared counts,
+    // which are updated in O(1) when a data point changes sides
+    std::vector<double>& countsLeft = ws._countsLeft;
+    std::vector<double>& countsRight = ws._countsRight;
+    countsLeft.assign(_data->_classValues.n_elem, 0.0);
+    countsRight.assign(totals._classCounts.begin(), totals._classCounts.end());
+    double squaresLeft = 0.0, squaresRight = totals._squares;
+    for (arma::uword splitIndex = 0; splitIndex < nodeSize - 1; ++splitIndex) {
+      arma::uword code = _data->_labelCodes(rows[splitIndex]);
+      squaresLeft += 2.0 * countsLeft[code] + 1.0;
+      squaresRight -= 2.0 * countsRight[code] - 1.0;
+      countsLeft[code] += 1.0;
+      countsRight[code] -= 1.0;
+
+      // check that this is NEW split value i.e. different from the previous one
+      // this is to avoid unrealistic splitting
+      if(newSplitValue(column[rows[splitIndex]], column[rows[splitIndex + 1]])) {
+        ++evaluated;
+        double leftSize = (double)(splitIndex + 1), rightSize = (double)(nodeSize - splitIndex - 1);
+        double score = (1.0 - squaresLeft / (leftSize * leftSize)) * (leftSize / (double)nodeSize) +
+          (1.0 - squaresRight / (rightSize * rightSize)) * (rightSize / (double)nodeSize);
+        if (score < best._score) {
+          best._score = score;
+          best._splitValue = _data->threshold(feature, column[rows[splitIndex]]);
+          best._found = true;
+        }
+      }
+    }
+  }
+  // type: regression tree
+  else {
+    RegressionStats statsLeft, statsRight(totals._regression);
+    for (arma::uword splitIndex = 0; splitIndex < nodeSize - 1; ++splitIndex) {
+      double y = Y(rows[splitIndex]) - totals._mean;
+      statsLeft.add(y);
+      statsRight.remove(y);
+
+      // calculate MSE based on the current splitting value
+      // make sure that the split is realistic: current splitting value is different from the previous one
+      if(newSplitValue(column[rows[splitIndex]], column[rows[splitIndex + 1]])) {
+        ++evaluated;
+        double score = (statsLeft.sse() + statsRight.sse()) / (double)nodeSize;
+        if (score < best._score) {
+          best._score = score;
+          best._splitValue = _data->threshold(feature, column[rows[splitIndex]]);
+          best._found = true;
+        }
+      }
+    }
+  }
+  countCandidates(evaluated);
+  return best;
+}
+
+std::vector<arma::uword> Tree::gatherNonzeros(const Node* nd, const arma::uvec& features,
+                                              std::vector<std::pair<double, arma::uword>>& nonzeros) const {
+  // Input: node, sampled features, buffer of the (value, row) pairs of the nonzeros of the node
+  // Output: offsets of the features in the buffer, the pairs of the i-th feature are in [offsets[i], offsets[i + 1])
+  // Process: walk the nonzeros of the rows of the node once and keep the ones of the sampled features
 
-Tree::Tree(const int& ident, const int& treeType, const arma::uword& maxNumFeatures,
-           const arma::uword& numFeatures, const int& maxDepth, const int& minCount):
-  _id(ident),
-  _treeType(treeType),
-  _maxNumFeatures(maxNumFeatures),
-  _numFeatures(numFeatures),
-  _maxDepth(maxDepth),
-  _minCount(minCount) {
-  // Input checks
-  if (_treeType < 0 || _treeType > 1) {
-    throw std::range_error("Tree type should be either 0 or 1");
+  PhaseTimer scanTimer(timer(&TrainingStats::_scanSeconds));
+  const arma::sp_mat& data = _data->_rowMajor;
+  const arma::uword* rows = _rows.memptr() + nd->_begin;
+  std::vector<arma::uword>& slots = workspace()._featureSlots;
+  const arma::uword notSampled = features.n_elem;
+  if (slots.size() != _maxNumFeatures) {
+    slots.assign(_maxNumFeatures, notSampled);
   }
-  if (_maxNumFeatures <= 0) {
-    throw std::range_error("Max number of features should be > 0");
+  for (arma::uword i = 0; i < features.n_elem; ++i) {
+    slots[features(i)] = i;
   }
-  if (_numFeatures <= 0) {
-    throw std::range_error("Number of features selected at each split should be > 0");
+
+  // count the nonzeros of every feature, then place them
+  std::vector<arma::uword> offsets(features.n_elem + 1, 0);
+  for (arma::uword i = 0; i < nd->size(); ++i) {
+    for (arma::uword k = data.col_ptrs[rows[i]]; k < data.col_ptrs[rows[i] + 1]; ++k) {
+      arma::uword slot = slots[data.row_indices[k]];
+      if (slot != notSampled) {
+        ++offsets[slot + 1];
+      }
+    }
   }
-  if (_maxNumFeatures < _numFeatures) {
-    throw std::range_error("Number of features selected at each split should be (<=) maximum number of features");
+  for (arma::uword i = 0; i < features.n_elem; ++i) {
+    offsets[i + 1] += offsets[i];
   }
-  if (_maxDepth <= 0) {
-    throw std::range_error("Max depth > 0");
+  nonzeros.resize(offsets.back());
+  countBytes((double)(nonzeros.size() * sizeof(nonzeros[0])));
+  std::vector<arma::uword> next(offsets.begin(), offsets.end() - 1);
+  for (arma::uword i = 0; i < nd->size(); ++i) {
+    for (arma::uword k = data.col_ptrs[rows[i]]; k < data.col_ptrs[rows[i] + 1]; ++k) {
+      arma::uword slot = slots[data.row_indices[k]];
+      if (slot != notSampled) {
+        nonzeros[next[slot]++] = std::make_pair(data.values[k], rows[i]);
+      }
+    }
   }
-  if (_minCount <= 0) {
-    throw std::range_error("Min count for a leaf node should be > 0");
+
+  for (arma::uword i = 0; i < features.n_elem; ++i) {
+    slots[features(i)] = notSampled;
   }
+  return offsets;
 }
 
-// Methods
-void Tree::train(arma::mat &X, arma::colvec &Y) {
-  // Input(explicit): data
+Tree::SplitCandidate Tree::scanNonzeros(const Node* nd, const arma::uword& feature,
+                                        std::pair<double, arma::uword>* nonzeros, const arma::uword& numNonzeros,
+                                        const arma::colvec &Y, const NodeStats& totals) const {
+  // Input: node, feature, (value, row) pairs of the nonzeros of the node along the feature, data,
+  // label statistics of the node
+  // Output: best split of the node along the feature
+  // Process: same sweep as scanFeature, but the data points with a zero value move to the left side at once,
+  // their statistics are the ones of the node minus the ones of the nonzeros
+
+  SplitCandidate best;
+  best._featureIndex = feature;
+  const arma::uword nodeSize = nd->size();
+  const arma::uword numZeros = nodeSize - numNonzeros;
+  Workspace& ws = workspace();
+
+  // sweep order: negative values, zeros, positive values, missing values
+  std::pair<double, arma::uword>* end;
+  {
+    PhaseTimer sortTimer(timer(&TrainingStats::_sortSeconds));
+    end = std::partition(nonzeros, nonzeros + numNonzeros,
+                         [](const std::pair<double, arma::uword>& nonzero) { return !std::isnan(nonzero.first); });
+    std::sort(nonzeros, end);
+  }
+  PhaseTimer evalTimer(timer(&TrainingStats::_evalSeconds));
+  const arma::uword numNegative = std::partition_point(nonzeros, end,
+                                                       [](const std::pair<double, arma::uword>& nonzero) {
+                                                         return nonzero.first < 0.0;
+                                                       }) - nonzeros;
+  const arma::uword numSteps = numNonzeros + (numZeros > 0);
+  auto stepValue = [&](const arma::uword& step) {
+    if (numZeros > 0 && step >= numNegative) {
+      return (step == numNegative) ? 0.0 : nonzeros[step - 1].first;
+    }
+    return nonzeros[step].first;
+  };
+
+  // statistics of both sides of the split, the zeros start on the right side
+  std::vector<double>& countsLeft = ws._countsLeft;
+  std::vector<double>& countsRight = ws._countsRight;
+  std::vector<double>& countsZero = ws._countsZero;
+  double squaresLeft = 0.0, squaresRight = totals._squares;
+  RegressionStats statsLeft, statsRight(totals._regression), statsZero(totals._regression);
+  if (_treeType == 0) {
+    countsLeft.assign(_data->_classValues.n_elem, 0.0);
+    countsRight.assign(totals._classCounts.begin(), totals._classCounts.end());
+    countsZero.assign(totals._classCounts.begin(), totals._classCounts.end());
+    for (arma::uword i = 0; i < numNonzeros; ++i) {
+      countsZero[_data->_labelCodes(nonzeros[i].second)] -= 1.0;
+    }
+  } else {
+    for (arma::uword i = 0; i < numNonzeros; ++i) {
+      statsZero.remove(Y(nonzeros[i].second) - totals._mean);
+    }
+  }
+  // move count data points of the class code to the left side
+  auto moveClass = [&](const arma::uword& code, const double& count) {
+    squaresLeft += 2.0 * count * countsLeft[code] + count * count;
+    squaresRight -= 2.0 * count * countsRight[code] - count * count;
+    countsLeft[code] += count;
+    countsRight[code] -= count;
+  };
+
+  arma::uword leftSize = 0, evaluated = 0;
+  for (arma::uword step = 0; step + 1 < numSteps; ++step) {
+    if (numZeros > 0 && step == numNegative) {
+      if (_treeType == 0) {
+        for (arma::uword code = 0; code < countsZero.size(); ++code) {
+          if (countsZero[code] > 0.0) {
+            moveClass(code, countsZero[code]);
+          }
+        }
+      } else {
+        statsLeft.add(statsZero);
+        statsRight.remove(statsZero);
+      }
+      leftSize += numZeros;
+    } else {
+      arma::uword row = nonzeros[(numZeros > 0 && step > numNegative) ? step - 1 : step].second;
+      if (_treeType == 0) {
+        moveClass(_data->_labelCodes(row), 1.0);
+      } else {
+        double y = Y(row) - totals._mean;
+        statsLeft.add(y);
+        statsRight.remove(y);
+      }
+      leftSize += 1;
+    }
+
+    if (newSplitValue(stepValue(step), stepValue(step + 1))) {
+      ++evaluated;
+      double score;
+      if (_treeType == 0) {
+        double sizeLeft = (double)leftSize, sizeRight = (double)(nodeSize - leftSize);
+        score = (1.0 - squaresLeft / (sizeLeft * sizeLeft)) * (sizeLeft / (double)nodeSize) +
+          (1.0 - squaresRight / (sizeRight * sizeRight)) * (sizeRight / (double)nodeSize);
+      } else {
+        score = (statsLeft.sse() + statsRight.sse()) / (double)nodeSize;
+      }
+      if (score < best._score) {
+        best._score = score;
+        best._splitValue = stepValue(step);
+        best._found = true;
+      }
+    }
+  }
+  countCandidates(evaluated);
+  return best;
+}
+
+void Tree::partition(Node* nd, const arma::mat &X) {
+  // Input: node with the chosen split, data
   // Output: none
-  // Process: build a decision tree
+  // Process: create the children and hand them the two parts of the range of the node
 
-  // Input checks
-  if (X.n_cols != _maxNumFeatures) {
-    throw std::range_error("Dataset should have number of features = max number of features");
+  PhaseTimer partitionTimer(timer(&TrainingStats::_partitionSeconds));
+  countBytes((double)(2 * sizeof(Node)));
+  // data points with the feature value <= splitting value go to the left node, the order of the node is kept
+  arma::uword* rows = _rows.memptr() + nd->_begin;
+  if (_splitMethod == 2) {
+    // the bins of the data are in memory, e.g. the data file is only read once by prepare()
+    // the rows with the bin <= bin of the splitting value are the ones with the value <= splitting value
+    const unsigned char* column = _data->_bins.colptr(nd->_featureIndex);
+    const arma::vec& edges = _data->_binEdges[nd->_featureIndex];
+    const unsigned char splitBin = (unsigned char)(std::lower_bound(edges.begin(), edges.end(), nd->_splitValue) -
+                                                   edges.begin());
+    for (arma::uword i = 0; i < nd->size(); ++i) {
+      _goesLeft[rows[i]] = column[rows[i]] <= splitBin;
+    }
+  } else if (_data->_sparse) {
+    for (arma::uword i = 0; i < nd->size(); ++i) {
+      _goesLeft[rows[i]] = Dataset::sparseValue(_data->_rowMajor, rows[i], nd->_featureIndex) <= nd->_splitValue;
+    }
+  } else if (_data->_storage == 1) {
+    // the splitting value is the threshold of a float, the floats <= splitting value are the ones <= the float
+    const float* column = _data->_Xf.colptr(nd->_featureIndex);
+    for (arma::uword i = 0; i < nd->size(); ++i) {
+      _goesLeft[rows[i]] = column[rows[i]] <= nd->_splitValue;
+    }
+  } else if (_data->_storage == 2) {
+    const std::uint16_t* column = _data->_codes.colptr(nd->_featureIndex);
+    const std::uint16_t splitCode = _data->code(nd->_featureIndex, nd->_splitValue);
+    for (arma::uword i = 0; i < nd->size(); ++i) {
+      _goesLeft[rows[i]] = column[rows[i]] <= splitCode;
+    }
+  } else {
+    const double* column = X.colptr(nd->_featureIndex);
+    for (arma::uword i = 0; i < nd->size(); ++i) {
+      _goesLeft[rows[i]] = column[rows[i]] <= nd->_splitValue;
+    }
   }
-  if (X.n_rows <= 0) {
-    throw std::range_error("Data set should contain at least 1 data row");
+  arma::uword leftSize = partitionRange(rows, nd->size(), _goesLeft.data());
+
+  nd->_left = new Node(nd->_depth + 1);
+  nd->_right = new Node(nd->_depth + 1);
+  nd->_left->_seed = RandomStream::derive(nd->_seed, 1);
+  nd->_right->_seed = RandomStream::derive(nd->_seed, 2);
+  nd->_left->_begin = nd->_begin;
+  nd->_left->_end = nd->_begin + leftSize;
+  nd->_right->_begin = nd->_begin + leftSize;
+  nd->_right->_end = nd->_end;
+
+  if (_splitMethod == 1) {
+    partitionSorted(nd);
   }
-  if (Y.n_elem != X.n_rows) {
-    throw std::range_error("Mismatch between dimensions of X and Y");
+}
+
+arma::uword Tree::partitionRange(arma::uword* rows, const arma::uword& size, const char* goesLeft) const {
+  // Input: range of rows, side of the split taken by each row of the data
+  // Output: number of rows going to the left side
+  // Process: stable partition of the range in place, the rows going to the right side wait in the scratch space
+
+  std::vector<arma::uword>& buffer = workspace()._rowBuffer;
+  if (buffer.size() < size) {
+    countBytes((double)((size - buffer.size()) * sizeof(arma::uword)));
+    buffer.resize(size);
+  }
+  arma::uword leftSize = 0, rightSize = 0;
+  for (arma::uword i = 0; i < size; ++i) {
+    if (goesLeft[rows[i]]) {
+      rows[leftSize++] = rows[i];
+    } else {
+      buffer[rightSize++] = rows[i];
+    }
+  }
+  std::copy(buffer.begin(), buffer.begin() + rightSize, rows + leftSize);
+  return leftSize;
+}
+
+std::vector<std::uint32_t> Tree::countRows(const Node* nd) const {
+  // Input: node
+  // Output: number of times every row of the data appears in the node (a row drawn k times appears k times)
+  countBytes((double)(_data->_numRows * sizeof(std::uint32_t)));
+  std::vector<std::uint32_t> counts(_data->_numRows, 0);
+  const arma::uword* rows = _rows.memptr() + nd->_begin;
+  for (arma::uword i = 0; i < nd->size(); ++i) {
+    ++counts[rows[i]];
+  }
+  return counts;
+}
+
+void Tree::walkSorted(const arma::uword& feature, const std::uint32_t* rowCounts, arma::uword* rows) const {
+  // Input: feature, number of times every row of the data appears in a node, buffer of the size of the node
+  // Output: none, rows holds the rows of the node sorted by the feature
+  // Process: walk the sorted column of the dataset, which is shared by all the trees, and keep the rows of the node
+  const arma::uword* sortedRows = _data->_sortedRows.colptr(feature);
+  for (arma::uword i = 0; i < _data->_numRows; ++i) {
+    for (std::uint32_t k = 0; k < rowCounts[sortedRows[i]]; ++k) {
+      *rows++ = sortedRows[i];
+    }
+  }
+}
+
+void Tree::sortBlock(Node* nd) {
+  // Input: node without a sorted block
+  // Output: none
+  // Process: sort the rows of the node by every feature into a block shared by its subtree, by walking the sorted
+  // columns of the dataset OR, when the node is much smaller than the data, by sorting its rows in the same order
+
+  PhaseTimer sortTimer(timer(&TrainingStats::_sortSeconds));
+  const arma::uword size = nd->size();
+  countBytes((double)(size * _maxNumFeatures * sizeof(arma::uword)));
+  std::shared_ptr<SortedBlock> block = std::make_shared<SortedBlock>();
+  block->_rows.set_size(size, _maxNumFeatures);
+  block->_begin = nd->_begin;
+  const arma::uword* nodeRows = _rows.memptr() + nd->_begin;
+  if ((double)size * std::log2((double)size + 1.0) < (double)_data->_numRows) {
+    for (arma::uword feature = 0; feature < _maxNumFeatures; ++feature) {
+      arma::uword* rows = block->_rows.colptr(feature);
+      std::copy(nodeRows, nodeRows + size, rows);
+      _data->sortRows(feature, rows, size);
+    }
+  } else {
+    std::vector<std::uint32_t> rowCounts = countRows(nd);
+    for (arma::uword feature = 0; feature < _maxNumFeatures; ++feature) {
+      walkSorted(feature, rowCounts.data(), block->_rows.colptr(feature));
+    }
   }
+  nd->_sorted = block;
+}
+
+void Tree::partitionSorted(Node* nd) {
+  // Input: split node
+  // Output: none
+  // Process: stable partition of the range of the node in every column of its sorted block, which keeps both children
+  // sorted, the children take over the block. The large nodes have no block, their children walk the dataset OR sort
+  // their own blocks.
 
-  _root = new Node(0); // create root node
-  _root->_dataPoints = arma::regspace<arma::uvec>(0, 1, X.n_rows - 1); // feed data to the root node
-  Tree::buildTree(_root, X, Y); // start building the tree
+  if (nd->_sorted == nullptr) {
+    return;
+  }
+  arma::umat& sortedRows = nd->_sorted->_rows;
+  const arma::uword offset = nd->_begin - nd->_sorted->_begin;
+  auto partitionColumn = [&](const arma::uword& feature) {
+    partitionRange(sortedRows.colptr(feature) + offset, nd->size(), _goesLeft.data());
+  };
+  if (parallelFeatures(nd)) {
+#ifdef _OPENMP
+#pragma omp taskloop grainsize(1)
+#endif
+    for (arma::uword feature = 0; feature < _maxNumFeatures; ++feature) {
+      partitionColumn(feature);
+    }
+  } else {
+    for (arma::uword feature = 0; feature < _maxNumFeatures; ++feature) {
+      partitionColumn(feature);
+    }
+  }
+  nd->_left->_sorted = nd->_sorted;
+  nd->_right->_sorted = nd->_sorted;
+  nd->_sorted.reset();
 }
 
-void Tree::buildTree(Node* nd, arma::mat &X, arma::colvec &Y){
+void Tree::buildHistogram(Node* nd, const arma::colvec &Y) {
   // Input: node, data
   // Output: none
-  // Process: check if the node can be split, split the node, continue building the tree
+  // Process: accumulate the label statistics of the data points of the node in every bin of every feature
+  // bin statistics (one column per bin): count, class counts (classification) OR count, sum, sum of squares (regression)
 
-  if (Tree::stop(nd, Y)){
-    classResult(nd, Y);
-  } else{
-    if (split(nd, X, Y)) {
-      Tree::buildTree(nd->_left, X, Y);
-      Tree::buildTree(nd->_right, X, Y);
+  const arma::uword numStats = (_treeType == 0) ? _data->_classValues.n_elem + 1 : 3;
+  acquireHistogram(nd);
+  if (nd->_histogram.n_elem == 0) {
+    countBytes((double)(numStats * _data->_binOffset.back() * sizeof(double))); // none left in the pool
+  }
+  nd->_histogram.zeros(numStats, _data->_binOffset.back());
+  const arma::uword* rows = _rows.memptr() + nd->_begin;
+  auto accumulate = [&](const arma::uword& feature) {
+    PhaseTimer scanTimer(timer(&TrainingStats::_scanSeconds));
+    const unsigned char* binColumn = _data->_bins.colptr(feature);
+    double* hist = nd->_histogram.colptr(_data->_binOffset[feature]);
+    if (_treeType == 0) {
+      for (arma::uword i = 0; i < nd->size(); ++i) {
+        double* bin = hist + binColumn[rows[i]] * numStats;
+        bin[0] += 1.0;
+        bin[1 + _data->_labelCodes(rows[i])] += 1.0;
+      }
     } else {
-      classResult(nd, Y);
+      for (arma::uword i = 0; i < nd->size(); ++i) {
+        double* bin = hist + binColumn[rows[i]] * numStats;
+        double y = Y(rows[i]) - _data->_labelShift;
+        bin[0] += 1.0;
+        bin[1] += y;
+        bin[2] += y * y;
+      }
+    }
+  };
+  // the features of large nodes are accumulated in parallel
+  if (parallelFeatures(nd)) {
+#ifdef _OPENMP
+#pragma omp taskloop grainsize(1)
+#endif
+    for (arma::uword feature = 0; feature < _maxNumFeatures; ++feature) {
+      accumulate(feature);
+    }
+  } else {
+    for (arma::uword feature = 0; feature < _maxNumFeatures; ++feature) {
+      accumulate(feature);
     }
   }
 }
 
-bool Tree::split(Node *nd, arma::mat &X, arma::colvec &Y) {
-  // Input: node, data
+void Tree::acquireHistogram(Node* nd) {
+  // Input: node
   // Output: none
-  // Process: split the node
+  // Process: hand a released histogram to the node, so that its memory is reused
+#ifdef _OPENMP
+#pragma omp critical(histogramPool)
+#endif
+  {
+    if (!_histogramPool.empty()) {
+      nd->_histogram = std::move(_histogramPool.back());
+      _histogramPool.pop_back();
+    }
+  }
+}
 
-  // flag indicating wether at least one splitting value was found
-  bool splitted = false;
+void Tree::releaseNode(Node* nd) {
+  // Input: node which is a leaf OR whose subtree is built
+  // Output: none
+  // Process: release the buffers of the node, the sorted block is freed with the last node of its subtree
+  releaseHistogram(nd);
+  nd->_sorted.reset();
+}
 
-  // data points sets for next nodes
-  arma::uvec leftNodeDatapoints, rightNodeDatapoints;
+void Tree::releaseHistogram(Node* nd) {
+  // Input: node
+  // Output: none
+  // Process: give the histogram of the node back to the pool
+  if (nd->_histogram.n_elem == 0) {
+    return;
+  }
+#ifdef _OPENMP
+#pragma omp critical(histogramPool)
+#endif
+  _histogramPool.push_back(std::move(nd->_histogram));
+  nd->_histogram.reset();
+}
 
-  //shuffle linear space of column indices
-  // select the first numFeatures from the shuffled linear space
-  arma::uvec featureSubsetIndex = arma::shuffle(arma::regspace<arma::uvec>(0, 1, _maxNumFeatures - 1));
-  featureSubsetIndex = featureSubsetIndex.subvec(0, _numFeatures - 1);
+double Tree::histogramScore(const double* left, const double* right, const arma::uword& numClasses) const {
+  // Input: statistics of the left and the right sides of the split, number of classes (classification)
+  // Output: Gini score (classification) OR MSE (regression) of the split
+  // Process: evaluate the split from the accumulated bin statistics
 
-  // Example below explains how we want to sort the values within column
-  // 3 1 2 5 - sub-column values
-  // 4 5 6 7 - index of sub-column within column
-  // 1 2 0 3 - index of sorted sub-column values
-  arma::uvec index; // vector to store indices of elements in column as they would appear when sorted
+  if (_treeType == 0) {
+    return gini(left + 1, right + 1, numClasses, left[0], right[0]);
+  }
+  double leftSse = left[2] - left[1] * left[1] / left[0];
+  double rightSse = right[2] - right[1] * right[1] / right[0];
+  return (leftSse + rightSse) / (left[0] + right[0]);
+}
 
-  // create map of class -> count
-  std::map<double, int> classSet = {};
+bool Tree::findSplitHistogram(Node* nd) {
+  // Input: node with its histogram
+  // Output: boolean indicating whether a split was found
+  // Process: find the best split by scanning the bins of the sampled features, keep it and its gain in the node
 
-  // set the error measures
-  double msePrev = std::numeric_limits<double>::infinity(), mseNew = std::numeric_limits<double>::infinity();
-  double scoreGiniPrev = 10.0, scoreGiniNew = 11.0;
+  arma::uvec featureSubsetIndex = sampleFeatures(nd->_seed);
+  const arma::uword numStats = nd->_histogram.n_rows;
 
-  // calculate class -> count from the data
-  if (_treeType == 0) {
-    for (arma::uword i = 0; i < nd->_dataPoints.n_elem; ++i) {
-      ++classSet[Y(nd->_dataPoints(i))]; // creating map of label -> count
+  // statistics of the whole node: sum over the bins of any feature
+  arma::vec totalStats(numStats, arma::fill::zeros), leftStats(numStats), rightStats(numStats);
+  for (arma::uword bin = 0; bin < _data->_binEdges[0].n_elem; ++bin) {
+    for (arma::uword s = 0; s < numStats; ++s) {
+      totalStats(s) += nd->_histogram(s, bin);
     }
   }
-  std::map<double, int> classSetLeft, classSetRight(classSet);
-
-  for (arma::uword feature : featureSubsetIndex) {
-    arma::uvec indFeature = {feature};
-    // nd->_dataPoints - rows of dataset (X, Y) correspoding to the node
-    // index - vector which describes the sorted order of the elements of the column "feature" among the "dataPoints"
-    index = arma::sort_index(X.submat(nd->_dataPoints, indFeature));
-    for (arma::uword splitIndex = 0; splitIndex < index.n_elem - 1; ++splitIndex) {
-      // type: classification tree
-      if (_treeType == 0) {
-        ++classSetLeft[Y(nd->_dataPoints(index(splitIndex)))];
-        --classSetRight[Y(nd->_dataPoints(index(splitIndex)))];
 
-        if(X(nd->_dataPoints(index(splitIndex)), feature) != X(nd->_dataPoints(index(splitIndex + 1)), feature)) {
-          // check that this is NEW split value i.e. different from the previous one
-          // this is to avoid unrealistic splitting
-          scoreGiniNew = gini(classSetLeft, classSetRight, nd->_dataPoints.n_elem);
+  bool splitted = false;
+  double bestScore = std::numeric_limits<double>::infinity();
+  arma::uword bestFeature = 0, bestBin = 0, evaluated = 0;
+  {
+    PhaseTimer evalTimer(timer(&TrainingStats::_evalSeconds));
+    for (arma::uword feature : featureSubsetIndex) {
+      leftStats.zeros();
+      rightStats = totalStats;
+      const double* hist = nd->_histogram.colptr(_data->_binOffset[feature]);
+      for (arma::uword bin = 0; bin + 1 < _data->_binEdges[feature].n_elem; ++bin) {
+        const double* binStats = hist + bin * numStats;
+        if (binStats[0] == 0.0) {
+          continue; // empty bin: same split as the previous bin
         }
-
-        // update node and min Gini score values if the current Gini value is less than the known min
-        if (scoreGiniNew < scoreGiniPrev) {
-          scoreGiniPrev = scoreGiniNew;
-          nd->_featureIndex = feature;
-          nd->_splitValue = X(nd->_dataPoints(index(splitIndex)), feature);
-          leftNodeDatapoints = nd->_dataPoints(index.head(splitIndex + 1));
-          rightNodeDatapoints = nd->_dataPoints(index.tail(index.n_elem - splitIndex - 1));
-          splitted = true;
+        for (arma::uword s = 0; s < numStats; ++s) {
+          leftStats(s) += binStats[s];
+          rightStats(s) -= binStats[s];
         }
-      }
-      // type: regression tree
-      else {
-        // calculate MSE based on the current splitting value
-        // make sure that the split is realistic: current splitting value is different from the previous one
-        if(X(nd->_dataPoints(index(splitIndex)), feature) != X(nd->_dataPoints(index(splitIndex + 1)), feature)) {
-
-          arma::colvec leftY = Y(index.head(splitIndex + 1));
-          arma::colvec rightY = Y(index.tail(index.n_elem - splitIndex - 1));
-          arma::colvec leftMse = leftY - arma::mean(leftY);
-          arma::colvec rightMse = rightY - arma::mean(rightY);
-
-          mseNew = arma::accu(leftMse % leftMse) * (1 / (double)Y.size()) +
-            arma::accu(rightMse % rightMse) * (1 / (double)Y.size());
+        if (rightStats(0) == 0.0) {
+          break; // no data points left on the right side
         }
-        // update subsequent nodes and min MSE score accordingly
-        if (mseNew < msePrev) {
-          msePrev = mseNew;
-          nd->_featureIndex = feature;
-          nd->_splitValue = X(nd->_dataPoints(index(splitIndex)), feature);
-          leftNodeDatapoints = nd->_dataPoints(index.head(splitIndex + 1));
-          rightNodeDatapoints = nd->_dataPoints(index.tail(index.n_elem - splitIndex - 1));
+        double score = histogramScore(leftStats.memptr(), rightStats.memptr(), _data->_classValues.n_elem);
+        ++evaluated;
+        if (score < bestScore) {
+          bestScore = score;
+          bestFeature = feature;
+          bestBin = bin;
           splitted = true;
         }
       }
     }
+    countCandidates(evaluated);
+  }
 
-    // restore the class sets to inital states
-    classSetLeft = {};
-    classSetRight = classSet;
+  if (!splitted) {
+    return false;
+  }
+  // the data points with the bin <= best bin are exactly the ones with the value <= bin edge
+  nd->_featureIndex = bestFeature;
+  nd->_splitValue = _data->_binEdges[bestFeature](bestBin);
+  // impurity of the node: Gini index (classification) OR variance of the labels (regression)
+  const double size = totalStats(0);
+  double impurity = 0.0;
+  if (_treeType == 0) {
+    double squares = 0.0;
+    for (arma::uword s = 1; s < numStats; ++s) {
+      squares += totalStats(s) * totalStats(s);
+    }
+    impurity = 1.0 - squares / (size * size);
+  } else {
+    impurity = (totalStats(2) - totalStats(1) * totalStats(1) / size) / size;
   }
+  nd->_gain = size / (double)_rootSize * (impurity - bestScore);
+  return true;
+}
+
+void Tree::splitHistograms(Node* nd, const arma::colvec &Y) {
+  // Input: split node with its histogram, data
+  // Output: none
+  // Process: hand the children that can be split their histograms, then release the histogram of the node
 
-  if (splitted) {
-    nd->_left = new Node(nd->_depth + 1);
-    nd->_right = new Node(nd->_depth + 1);
-    nd->_left->_dataPoints = leftNodeDatapoints;
-    nd->_right->_dataPoints = rightNodeDatapoints;
+  // build the histogram of the smaller child only, the other one is the difference with the parent
+  Node* smaller = (nd->_left->size() <= nd->_right->size()) ? nd->_left : nd->_right;
+  Node* larger = (smaller == nd->_left) ? nd->_right : nd->_left;
+  if (canSplit(larger)) {
+    buildHistogram(smaller, Y);
+    larger->_histogram = std::move(nd->_histogram); // the parent histogram becomes the one of the larger child
+    larger->_histogram -= smaller->_histogram;
+    if (!canSplit(smaller)) {
+      releaseHistogram(smaller);
+    }
+  } else if (canSplit(smaller)) {
+    buildHistogram(smaller, Y);
   }
-  return splitted;
+  // the bin statistics of the parent are no longer needed
+  releaseHistogram(nd);
+}
+
+bool Tree::canSplit(const Node* nd) const {
+  // Input: node
+  // Output: boolean indicating whether the depth and the size of the node allow a split
+  return nd->_depth < (arma::uword)_maxDepth && nd->size() > (arma::uword)_minCount;
 }
 
-bool Tree::stop(const Node* nd, arma::colvec &Y) const {
+bool Tree::stop(const Node* nd, const arma::colvec &Y) const {
   // Input: node, data
   // Output: boolean indicating whether the node can be split
   // Process: check if the node can be split
@@ -189,15 +1931,16 @@ bool Tree::stop(const Node* nd, arma::colvec &Y) const {
     return true;
   }
   // check that more than minCount number of points for a leaf
-  if (nd->_dataPoints.n_elem <= _minCount) {
+  if (nd->size() <= (arma::uword)_minCount) {
     return true;
   }
   // check that the label pool is not homogenuous for a classification tree
   bool first_iter = true;
   double nw = 0.0, prev = 0.0;
-  for (const auto& point : nd->_dataPoints) {
+  const arma::uword* rows = _rows.memptr() + nd->_begin;
+  for (arma::uword i = 0; i < nd->size(); ++i) {
     prev = nw;
-    nw = Y(point);
+    nw = Y(rows[i]);
 
     if (first_iter) {
       first_iter = false;
@@ -211,47 +1954,62 @@ bool Tree::stop(const Node* nd, arma::colvec &Y) const {
   return true;
 }
 
-void Tree::classResult(Node* nd, arma::colvec &Y) const {
+void Tree::classResult(Node* nd, const arma::colvec &Y) const {
   // Input: node, data
   // Output: none
   // Process: calculate leaf value based on the data
 
+  PhaseTimer leafTimer(timer(&TrainingStats::_leafSeconds));
   nd->_leaf = true;
+  const arma::uword* rows = _rows.memptr() + nd->_begin;
   // type: classification tree
   if (_treeType == 0) {
-    std::map<double, double> classSet;
+    // the most frequent class, ties go to the class which reaches the count first
+    std::vector<double>& classCounts = workspace()._countsLeft;
+    classCounts.assign(_data->_classValues.n_elem, 0.0);
     double count = 0;
-    for (const auto& point : nd->_dataPoints) {
-      classSet[Y(point)] += 1;
-      if (classSet[Y(point)] > count) {
-        count = classSet[Y(point)];
-        nd->_classResult = Y(point);
+    for (arma::uword i = 0; i < nd->size(); ++i) {
+      arma::uword code = _data->_labelCodes(rows[i]);
+      classCounts[code] += 1;
+      if (classCounts[code] > count) {
+        count = classCounts[code];
+        nd->_classResult = _data->_classValues(code);
       }
     }
   }
   // type: regression tree
   else {
-    nd->_classResult = arma::mean(Y(nd->_dataPoints));
+    double sum = 0.0;
+    for (arma::uword i = 0; i < nd->size(); ++i) {
+      sum += Y(rows[i]);
+    }
+    nd->_classResult = sum / (double)nd->size();
   }
 }
 
-double Tree::gini(const std::map<double, int>& classSetLeft, const std::map<double, int>& classSetRight,
-                  const double& totalSize) const {
-  double giniVal = 0.0;
+double Tree::gini(const double* countsLeft, const double* countsRight, const arma::uword& numClasses,
+                  const double& leftSize, const double& rightSize) const {
+  // Input: class counts of the left and the right sides of the split, sizes of the sides
+  // Output: Gini score of the split weighted by the sizes of the sides
   double leftScore = 0.0;
-  double leftSize = 0.0;
   double rightScore = 0.0;
-  arma::uword rightSize = 0;
-  for (auto& classVal : classSetLeft) {
-    leftSize += classVal.second;
-    leftScore += classVal.second * classVal.second;
+  if (numClasses == 2) {
+    // binary classification: no loop
+    leftScore = countsLeft[0] * countsLeft[0] + countsLeft[1] * countsLeft[1];
+    rightScore = countsRight[0] * countsRight[0] + countsRight[1] * countsRight[1];
+  } else {
+#ifdef _OPENMP
+#pragma omp simd reduction(+:leftScore,rightScore)
+#endif
+    for (arma::uword k = 0; k < numClasses; ++k) {
+      leftScore += countsLeft[k] * countsLeft[k];
+      rightScore += countsRight[k] * countsRight[k];
+    }
   }
+  double giniVal = 0.0;
+  double totalSize = leftSize + rightSize;
   if (leftSize != 0.0) {
-    giniVal +=  (1.0 - leftScore / (leftSize * leftSize)) * (leftSize / totalSize);
-  }
-  for (auto& classVal : classSetRight) {
-    rightSize += classVal.second;
-    rightScore += classVal.second * classVal.second;
+    giniVal += (1.0 - leftScore / (leftSize * leftSize)) * (leftSize / totalSize);
   }
   if (rightSize != 0.0) {
     giniVal += (1.0 - rightScore / (rightSize * rightSize)) * (rightSize / totalSize);
@@ -260,35 +2018,264 @@ double Tree::gini(const std::map<double, int>& classSetLeft, const std::map<doub
 }
 
 arma::colvec Tree::predict(const arma::mat& X) const {
+  return predict(X, 1);
+}
+
+arma::colvec Tree::predict(const arma::sp_mat& X) const {
+  return predict(X, 1);
+}
+
+arma::colvec Tree::predict(const arma::sp_mat& X, const int& numThreads) const {
+  // Input checks
+  if (_nodes.empty()) {
+    throw std::range_error("The tree should be trained before making predictions");
+  }
+  if (X.n_rows <= 0) {
+    throw std::range_error("Data set should contain at least 1 data row");
+  }
+  if (X.n_cols != _maxNumFeatures) {
+    throw std::range_error("Data set should have the number of features = max number of features");
+  }
+  if (numThreads <= 0) {
+    throw std::range_error("Number of threads should be > 0");
+  }
+
+  // the nonzeros of every row are adjacent in the transpose, every node looks its feature up among them
+  const arma::sp_mat rowMajor = X.t();
+  arma::colvec Ypred(X.n_rows);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads(numThreads)
+#endif
+  for (arma::uword row = 0; row < X.n_rows; ++row) {
+    Ypred(row) = predictRow(rowMajor, row);
+  }
+  return Ypred;
+}
+
+arma::colvec Tree::predict(const arma::mat& X, const int& numThreads) const {
   // Input checks
+  if (_nodes.empty()) {
+    throw std::range_error("The tree should be trained before making predictions");
+  }
   if (X.n_rows <= 0) {
     throw std::range_error("Data set should contain at least 1 data row");
   }
   if (X.n_cols != _maxNumFeatures) {
     throw std::range_error("Data set should have the number of features = max number of features");
   }
+  if (numThreads <= 0) {
+    throw std::range_error("Number of threads should be > 0");
+  }
 
-  // starting at the root
-  Node* nd = _root;
   // vector to store predicted values
   arma::colvec Ypred(X.n_rows);
 
-  // start at the root node and conseqeuntly go down the tree until a leaf node is reached
-  // repeat for each data row
-  for (arma::uword row = 0; row < X.n_rows; ++row) {
-    while (!nd->_leaf) {
-      if (X(row, nd->_featureIndex) <= nd->_splitValue) {
-        nd = nd->_left;
-      } else {
-        nd = nd->_right;
+  // the rows are processed in blocks, the blocks are shared between the threads
+  const arma::uword blockSize = predictBlockSize();
+  const arma::uword numBlocks = (X.n_rows + blockSize - 1) / blockSize;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads)
+#endif
+  {
+    // per thread buffers: row-major copy of the block and current node of every row
+    std::vector<double> tile(blockSize * _maxNumFeatures);
+    std::vector<std::uint32_t> nodeIndex(blockSize);
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for (arma::uword block = 0; block < numBlocks; ++block) {
+      arma::uword first = block * blockSize;
+      arma::uword size = std::min(blockSize, X.n_rows - first);
+      // the bitvector form reads the columns of the data, it needs no tile
+      if (!useBitvectors()) {
+        fillTile(X, first, size, tile.data());
+      }
+      descendBlock(X, first, size, tile.data(), nodeIndex.data());
+      for (arma::uword i = 0; i < size; ++i) {
+        Ypred(first + i) = _nodes[nodeIndex[i]]._value;
       }
     }
-    Ypred(row) = nd->_classResult;
-    nd = _root;
   }
   return Ypred;
 }
 
+void Tree::fillTile(const arma::mat& X, const arma::uword& first, const arma::uword& size, double* tile) {
+  // Input: data, first row and number of rows of the block, buffer of size x (number of features)
+  // Output: none
+  // Process: copy the block into a row-major tile, so that the features of a row are adjacent
+
+  const arma::uword numFeatures = X.n_cols;
+  for (arma::uword feature = 0; feature < numFeatures; ++feature) {
+    const double* column = X.colptr(feature) + first;
+    for (arma::uword i = 0; i < size; ++i) {
+      tile[i * numFeatures + feature] = column[i];
+    }
+  }
+}
+
+void Tree::descendBlock(const arma::mat& X, const arma::uword& first, const arma::uword& size, const double* tile,
+                        std::uint32_t* nodeIndex) const {
+  // Input: data, first row and number of rows of the block, row-major tile of the block, buffer of size nodes
+  // Output: none, nodeIndex holds the leaf reached by every row of the block
+  // Process: move all the rows of the block down the tree one level at a time, OR score them with the bitvector form
+
+  if (useBitvectors()) {
+    switch (_bitvectors._words) {
+    case 1:
+      scoreBitvectors<1>(X, first, size, nodeIndex);
+      return;
+    case 2:
+      scoreBitvectors<2>(X, first, size, nodeIndex);
+      return;
+    case 3:
+      scoreBitvectors<3>(X, first, size, nodeIndex);
+      return;
+    case 4:
+      scoreBitvectors<4>(X, first, size, nodeIndex);
+      return;
+    }
+  }
+
+  const arma::uword numFeatures = _maxNumFeatures;
+  std::fill(nodeIndex, nodeIndex + size, 0);
+  const CompactNode* nodes = _nodes.data();
+  for (arma::uword level = 0; level < _treeDepth; ++level) {
+    for (arma::uword i = 0; i < size; ++i) {
+      const CompactNode& node = nodes[nodeIndex[i]];
+      // the right child follows the left one, a leaf keeps the row where it is
+      std::uint32_t next = node._left + !(tile[i * numFeatures + node._featureIndex] <= node._value);
+      std::uint32_t split = 0u - (std::uint32_t)(node._left != 0);
+      nodeIndex[i] = (next & split) | (nodeIndex[i] & ~split);
+    }
+  }
+}
+
+bool Tree::useBitvectors() const {
+  // Output: predictions use the bitvector form of the tree
+  // Process: the bitvector form costs one masking per split and word of the masks for every row, the traversal
+  // one copy per feature into the tile and one step per level. Automatically, the bitvector form is used when the
+  // masking is cheaper than the copy (see inst/benchmarks/quickscorer.R)
+  if (_bitvectors._words == 0 || _quickScorer == 0) {
+    return false;
+  }
+  return _quickScorer == 1 ||
+    _bitvectors._thresholds.size() * _bitvectors._words <= std::max(quickScorerMinCost, _maxNumFeatures);
+}
+
+template <arma::uword W>
+void Tree::scoreBitvectors(const arma::mat& X, const arma::uword& first, const arma::uword& size,
+                           std::uint32_t* nodeIndex) const {
+  // Input: data, first row and number of rows of the block, buffer of size nodes
+  // Output: none, nodeIndex holds the leaf reached by every row of the block
+  // Process: every node masks out its left subtree for the rows whose value is above its splitting value,
+  // the leaf of a row is then the first leaf left. The loops over the rows read the columns of the data
+  // directly and have no branches, so that they are vectorized
+
+  const BitvectorTree& bv = _bitvectors;
+  const arma::uword chunk = 256;
+  std::uint64_t leaves[W * chunk]; // W words of leaves left for every row
+  for (arma::uword start = 0; start < size; start += chunk) {
+    const arma::uword rows = std::min(chunk, size - start);
+    std::fill(leaves, leaves + W * chunk, ~0ULL);
+    for (arma::uword f = 0; f < bv._features.size(); ++f) {
+      const double* column = X.colptr(bv._features[f]) + first + start;
+      for (arma::uword k = bv._offsets[f]; k < bv._offsets[f + 1]; ++k) {
+        const double threshold = bv._thresholds[k];
+        const std::uint64_t* mask = bv._masks.data() + k * W;
+        // a missing value is above every splitting value, as in the traversal
+        for (arma::uword i = 0; i < rows; ++i) {
+          const std::uint64_t below = 0ULL - (std::uint64_t)(column[i] <= threshold);
+          for (arma::uword w = 0; w < W; ++w) {
+            leaves[i * W + w] &= mask[w] | below;
+          }
+        }
+      }
+    }
+    for (arma::uword i = 0; i < rows; ++i) {
+      arma::uword w = 0;
+      while (leaves[i * W + w] == 0) {
+        ++w;
+      }
+      nodeIndex[start + i] = bv._leafNodes[w * 64 + lowestBit(leaves[i * W + w])];
+    }
+  }
+}
+
+void Tree::buildBitvectors() {
+  // Input: none
+  // Output: none
+  // Process: build the bitvector form of the trained tree when its depth allows it
+
+  _bitvectors = BitvectorTree();
+  if (_treeDepth > 8) {
+    return;
+  }
+  // number the leaves from left to right, every split covers the leaves of its left subtree
+  std::vector<BitvectorSplit> splits;
+  numberLeaves(_nodes, 0, _bitvectors._leafNodes, splits);
+  const arma::uword words = (_bitvectors._leafNodes.size() + 63) / 64;
+  std::stable_sort(splits.begin(), splits.end(), [](const BitvectorSplit& a, const BitvectorSplit& b) {
+    return a._featureIndex < b._featureIndex || (a._featureIndex == b._featureIndex && a._value < b._value);
+  });
+
+  _bitvectors._words = words;
+  _bitvectors._thresholds.reserve(splits.size());
+  _bitvectors._masks.reserve(splits.size() * words);
+  for (std::size_t k = 0; k < splits.size(); ++k) {
+    if (k == 0 || splits[k]._featureIndex != splits[k - 1]._featureIndex) {
+      _bitvectors._features.push_back(splits[k]._featureIndex);
+      _bitvectors._offsets.push_back((std::uint32_t)k);
+    }
+    _bitvectors._thresholds.push_back(splits[k]._value);
+    for (arma::uword w = 0; w < words; ++w) {
+      std::uint64_t mask = ~0ULL;
+      for (arma::uword leaf = std::max(splits[k]._first, w * 64); leaf < std::min(splits[k]._last, (w + 1) * 64); ++leaf) {
+        mask &= ~(1ULL << (leaf - w * 64));
+      }
+      _bitvectors._masks.push_back(mask);
+    }
+  }
+  _bitvectors._offsets.push_back((std::uint32_t)splits.size());
+}
+
+double Tree::predictRow(const arma::mat& X, const arma::uword& row) const {
+  // Input: data, row
+  // Output: prediction of the row
+  std::uint32_t nd = 0;
+  while (_nodes[nd]._left != 0) {
+    nd = _nodes[nd]._left + !(X(row, _nodes[nd]._featureIndex) <= _nodes[nd]._value);
+  }
+  return _nodes[nd]._value;
+}
+
+double Tree::predictRow(const Dataset& data, const arma::uword& row) const {
+  // Input: training data, row
+  // Output: prediction of the row, as seen by the splits in the storage of the data
+  std::uint32_t nd = 0;
+  while (_nodes[nd]._left != 0) {
+    nd = _nodes[nd]._left + !(data.value(row, _nodes[nd]._featureIndex) <= _nodes[nd]._value);
+  }
+  return _nodes[nd]._value;
+}
+
+double Tree::predictRow(const arma::sp_mat& rowMajor, const arma::uword& row) const {
+  // Input: sparse data with one column per row, row
+  // Output: prediction of the row
+  std::uint32_t nd = 0;
+  while (_nodes[nd]._left != 0) {
+    double value = Dataset::sparseValue(rowMajor, row, _nodes[nd]._featureIndex);
+    nd = _nodes[nd]._left + !(value <= _nodes[nd]._value);
+  }
+  return _nodes[nd]._value;
+}
+
+arma::uword Tree::predictBlockSize() const {
+  // Output: number of rows per prediction block
+  // Process: keep the row-major tile of a block within ~256KB
+  const arma::uword maxTile = 32768;
+  return std::max<arma::uword>(8, std::min<arma::uword>(256, maxTile / std::max<arma::uword>(1, _maxNumFeatures)));
+}
+
 arma::mat Tree::print() const {
   // print tree recursively starting from a root
   // matrix has
@@ -298,23 +2285,124 @@ arma::mat Tree::print() const {
   // 4th column: split value
   // 5th column: class result if leaf
   // first the left node row is added, then right node
-  arma::mat tr(0, 5);
-  Node* nd = _root;
-  printNode(nd, tr);
+  if (_nodes.empty()) {
+    throw std::range_error("The tree should be trained before printing it");
+  }
+  arma::mat tr(_nodes.size(), 5, arma::fill::zeros);
+  arma::uword row = 0;
+  printNode(0, 0, tr, row);
 
   return tr;
 }
 
-void Tree::printNode(Node* nd, arma::mat& tr) const {
-  if (nd->_leaf) {
-    tr.insert_rows(tr.n_rows, 1);
-    arma::rowvec vec = {(double)nd->_depth, 1, 0, 0, nd->_classResult};
-    tr.row(tr.n_rows - 1) = vec;
+void Tree::printNode(const std::uint32_t& nd, const arma::uword& depth, arma::mat& tr, arma::uword& row) const {
+  const CompactNode& node = _nodes[nd];
+  tr(row, 0) = (double)depth;
+  if (node._left == 0) {
+    tr(row, 1) = 1;
+    tr(row, 4) = node._value;
+    ++row;
+  } else {
+    tr(row, 2) = (double)node._featureIndex;
+    tr(row, 3) = node._value;
+    ++row;
+    printNode(node._left, depth + 1, tr, row);
+    printNode(node._left + 1, depth + 1, tr, row);
+  }
+}
+
+void Tree::save(const std::string& path) const {
+  // Input: path of the model file
+  // Output: none
+  // Process: write the header and the flat node array of the trained tree
+
+  if (_nodes.empty()) {
+    throw std::range_error("The tree should be trained before saving it");
+  }
+  ModelHeader header;
+  std::memcpy(header._magic, modelMagic, sizeof(modelMagic));
+  header._version = modelVersion;
+  header._id = _id;
+  header._treeType = _treeType;
+  header._maxDepth = _maxDepth;
+  header._minCount = _minCount;
+  header._splitMethod = _splitMethod;
+  header._maxNumFeatures = _maxNumFeatures;
+  header._numFeatures = _numFeatures;
+  header._numNodes = _nodes.size();
+  header._treeDepth = _treeDepth;
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("Cannot open file " + path);
+  }
+  if (littleEndianHost()) {
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(_nodes.data()), (std::streamsize)(_nodes.size() * sizeof(CompactNode)));
+  } else {
+    swapBytes(header);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (std::size_t nd = 0; nd < _nodes.size(); ++nd) {
+      CompactNode node = _nodes[nd];
+      swapBytes(node);
+      file.write(reinterpret_cast<const char*>(&node), sizeof(node));
+    }
+  }
+  if (!file) {
+    throw std::runtime_error("Cannot write file " + path);
+  }
+}
+
+void Tree::load(const std::string& path) {
+  // Input: path of a model file written by save()
+  // Output: none
+  // Process: map the file and predict directly from its node array, which is checked in one pass but not copied
+  // (trees of depth <= 8 also build their bitvector form)
+
+  std::shared_ptr<const MappedFile> file = std::make_shared<const MappedFile>(path);
+  ModelHeader header;
+  if (file->size() < sizeof(header)) {
+    throw std::range_error("File " + path + " is not a tree model");
+  }
+  std::memcpy(&header, file->data(), sizeof(header));
+  if (std::memcmp(header._magic, modelMagic, sizeof(modelMagic)) != 0) {
+    throw std::range_error("File " + path + " is not a tree model");
+  }
+  if (!littleEndianHost()) {
+    swapBytes(header);
+  }
+  if (header._version != modelVersion) {
+    throw std::range_error("Unsupported version of the tree model in " + path);
+  }
+  if (header._numNodes == 0 || file->size() != sizeof(header) + header._numNodes * sizeof(CompactNode) ||
+      header._treeType < 0 || header._treeType > 1 || header._maxNumFeatures == 0) {
+    throw std::range_error("File " + path + " is a corrupted tree model");
+  }
+
+  const CompactNode* nodes = reinterpret_cast<const CompactNode*>(file->data() + sizeof(header));
+  std::vector<CompactNode> swapped;
+  if (!littleEndianHost()) {
+    swapped.assign(nodes, nodes + header._numNodes);
+    for (auto& node : swapped) {
+      swapBytes(node);
+    }
+    nodes = swapped.data();
+  }
+  checkNodes(nodes, header, path);
+
+  clearOnline(); // the loaded tree replaces the one grown by update()
+  _id = header._id;
+  _treeType = header._treeType;
+  _maxDepth = header._maxDepth;
+  _minCount = header._minCount;
+  _splitMethod = header._splitMethod;
+  _maxNumFeatures = header._maxNumFeatures;
+  _numFeatures = header._numFeatures;
+  _treeDepth = header._treeDepth;
+  if (littleEndianHost()) {
+    _nodes.map(file, nodes, header._numNodes);
   } else {
-    tr.insert_rows(tr.n_rows, 1);
-    arma::rowvec vec = {(double)nd->_depth, 0, (double)nd->_featureIndex,  nd->_splitValue, 0};
-    tr.row(tr.n_rows - 1) = vec;
-    printNode(nd->_left, tr);
-    printNode(nd->_right, tr);
+    _nodes.assign(std::move(swapped));
   }
+  buildBitvectors();
 }
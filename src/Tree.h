@@ -6,15 +6,37 @@
 //' @param numFeatures Number of features selected at each split
 //' @param maxDepth The maximum depth to which the tree is grown
 //' @param minCount Minimum number of data points for a node to qualify as a leaf node
+//' @param splitMethod (optional) 0 to sort the data points at every node (default), 1 to sort every feature
+//' once per training (the large nodes walk the sorted columns, the small ones keep the sorted order of their
+//' subtree: faster for deep trees, uses more memory) and 2 to
+//' quantize every feature once per training into at most 255 bins and search the splits over the bins (fastest,
+//' the splitting values are restricted to the bin edges)
 //' @examples
 //' # Create a new object of class Tree with the given parameters
 //' tr = new(Tree, ident = 123, treeType = 0, maxNumFeatures = 20,
 //' numFeatures = 3, maxDepth = 4, minCount = 2)
+//' # Same tree, but the features are sorted only once per training
+//' tr = new(Tree, ident = 123, treeType = 0, maxNumFeatures = 20,
+//' numFeatures = 3, maxDepth = 4, minCount = 2, splitMethod = 1)
+//' # Same tree, but the splits are searched over the histograms of the features
+//' tr = new(Tree, ident = 123, treeType = 0, maxNumFeatures = 20,
+//' numFeatures = 3, maxDepth = 4, minCount = 2, splitMethod = 2)
 
 //' @name Tree$train
 //' @title Fits a Tree object to the given data
-//' @param X  Data matrix
+//' @param X  Data matrix, dense or sparse (dgCMatrix). The split search on sparse data only reads the nonzeros,
+//' the zeros of a feature are moved across the split at once. Sparse data requires splitMethod = 0.
+//' X may also be the path of a data file written by \code{writeColumns} or \code{csvToColumns} (without Y): its
+//' columns are memory-mapped and only the pages read by the nodes are loaded. The data does not need to fit in memory
+//' with splitMethod = 0 and featureStorage = 0, which read the sampled columns at the rows of every node, OR with
+//' splitMethod = 2, which reads the file once to bin it and keeps one byte per value in memory. The other
+//' combinations keep a copy as large as the data in memory: splitMethod = 1 the sorted rows of every feature
+//' (8 bytes per value), featureStorage = 1 OR 2 the float32 OR uint16 values (4 OR 2 bytes per value)
+//' X may also be a \code{Dataset} (without Y), whose preprocessing is kept for all the trainings on it
 //' @param Y  Vector of labels
+//' @param rows (with a Dataset) Rows of the dataset to train on, starting with 1. A row may appear several times
+//' @param weights (with a Dataset and rows) Frequency weight of every row of rows, a whole number >= 0: the row is
+//' used as many times as its weight
 //' @examples
 //' # Define a Tree object
 //' tr = new(Tree, ident = 123, treeType = 0, maxNumFeatures = 4,
@@ -24,10 +46,39 @@
 //' Y = c(0, 0, 1, 1, 2, 2, 2, 2)
 //' # Train the model
 //' tr$train(X, Y)
+//' # Train the model on the data written to a data file
+//' path = tempfile()
+//' writeColumns(X, Y, path)
+//' tr$train(path)
+//' # Train the model on the first 6 rows of a dataset built once
+//' ds = new(Dataset, X, Y, treeType = 0)
+//' tr$train(ds, 1:6)
+
+//' @name Tree$update
+//' @title Grows the Tree incrementally on a batch of new data
+//' @description Hoeffding tree: the tree is grown on a stream of batches without keeping them. Every leaf keeps the
+//' label statistics of the rows it has seen in at most 255 quantile bins of its sampled features (the bins of the
+//' first batch), and a leaf is split once the Hoeffding bound shows that its best split beats the second best
+//' feature (or no split) with probability 1 - hoeffdingDelta, or that the two are tied within tieThreshold.
+//' The leaves are checked every gracePeriod rows they see, and maxDepth and minCount still apply. The memory and the
+//' time of an update do not depend on the number of rows seen before. splitMethod is not used by the updates.
+//' A tree trained by train or loaded by load is not updated: train replaces the tree grown by the updates.
+//' @param X  Data matrix of the batch
+//' @param Y  Vector of labels of the batch, classes first seen in a later batch are added to the tree
+//' @examples
+//' tr = new(Tree, ident = 0, treeType = 0, maxNumFeatures = 4,
+//' numFeatures = 4, maxDepth = 10, minCount = 2)
+//' for (batch in 1:20) {
+//'   X = matrix(rnorm(2000), ncol = 4)
+//'   Y = as.numeric(X[, 1] + X[, 2] > 0)
+//'   tr$update(X, Y)
+//' }
+//' tr$print()
 
 //' @name Tree$predict
 //' @title Calculates predictions based on the Tree model
-//' @param X  Data matrix
+//' @param X  Data matrix, dense or sparse (dgCMatrix). The rows of sparse data are not densified
+//' @param numThreads (optional) Number of threads sharing the rows of the data matrix, 1 by default
 //' @return Vector of predictions corresponding to the data.
 //' @examples
 //' # Define a tree object
@@ -42,6 +93,8 @@
 //' Xtest = matrix(c(rnorm(8, 0, 2), rnorm(8, 20, 2)), nrow = 4, ncol = 4, byrow = TRUE)
 //' # Calculate predictions vector
 //' tr$predict(Xtest)
+//' # Calculate predictions vector with 2 threads
+//' tr$predict(Xtest, 2)
 
 //' @name Tree$print
 //' @title Prints the tree structure in the matrix form.
@@ -58,12 +111,49 @@
 //' # Assume a trained and defined Tree object, tr
 //' tr.Print()
 
+//' @name Tree$save
+//' @title Saves the trained Tree model to a binary file
+//' @description The file holds a small versioned header followed by the flat node array of the tree, 16 bytes per
+//' node, in little-endian byte order.
+//' @param path Path of the model file
+//' @examples
+//' # Assume a trained and defined Tree object, tr
+//' tr$save("tree.bin")
+
+//' @name Tree$load
+//' @title Loads a Tree model saved by save
+//' @description The file is memory-mapped and the predictions run directly on its node array, so that loading
+//' takes the same time for any size of the model. The file should not be modified while the model is in use.
+//' @param path Path of the model file
+//' @examples
+//' # Load a model saved with tr$save("tree.bin") and make predictions
+//' tr = new(Tree)
+//' tr$load("tree.bin")
+//' tr$predict(Xtest)
+
 #ifndef Tree_H
 #define Tree_H
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <map>
+#include <vector>
+#include <utility>
+#include <memory>
+#include <cstdint>
+#include <limits>
 #include <iostream>
-#include "RcppArmadillo.h"
-// [[Rcpp::depends(RcppArmadillo)]]
+#include <string>
+#include "CartArmadillo.h"
+#include "Dataset.h"
+#include "MappedFile.h"
+
+// Presorted mode: rows of a subtree sorted by every feature. The nodes of the subtree share the block, every node reads
+// and partitions the part of the columns at its range of the training row arena.
+struct SortedBlock {
+  arma::umat _rows; // one column per feature, one row per data point of the root of the subtree
+  arma::uword _begin = 0; // position of the root of the subtree in the row arena
+};
 
 class Node {
 public:
@@ -71,20 +161,217 @@ public:
   Node();
   Node(const arma::uword& d);
   Node(const Node& other);
-  // ~Node();
+  ~Node();
+  arma::uword size() const { return _end - _begin; }
 
 public:
   // fields
-  Node* _left;
-  Node* _right;
+  Node* _left = nullptr;
+  Node* _right = nullptr;
   arma::uword _depth;
-  arma::uvec _dataPoints;
+  arma::uword _begin = 0; // data points of the node: range [begin, end) of the training row arena of the tree
+  arma::uword _end = 0;
+  arma::mat _histogram; // histogram mode: label statistics of the node in every bin (one column per bin)
+  std::shared_ptr<SortedBlock> _sorted; // presorted mode: sorted rows of the subtree, none for the large nodes
   arma::uword _featureIndex;
+  std::uint64_t _seed = 0; // seed of the random stream used to sample the features of the node
   bool _leaf = false;
   double _splitValue;
+  double _gain = 0.0; // decrease of the impurity of the tree by the split found for the node
   double _classResult;
 };
 
+// Node of a trained tree in the flat layout used by predict() and print().
+// The tree is stored as a contiguous array in breadth-first order and the right child follows the left one.
+struct CompactNode {
+  double _value; // splitting value of a split node OR prediction of a leaf
+  std::uint32_t _featureIndex; // feature of the split
+  std::uint32_t _left; // index of the left child, 0 for a leaf
+};
+
+// Bitvector form (QuickScorer) of a trained tree of depth <= 8, i.e. with at most 256 leaves numbered from left to right.
+// The nodes are grouped by feature in increasing order of their splitting values. Every node holds the mask of the
+// leaves which stay reachable when a value is above its splitting value, i.e. all the leaves but the ones of its
+// left subtree. The leaf of a row is the first leaf left after applying the masks of all the nodes it goes right at.
+struct BitvectorTree {
+  arma::uword _words = 0; // 64-bit words per mask, 0 when the tree is too deep for the bitvector form
+  std::vector<std::uint32_t> _features; // features used by the splits
+  std::vector<std::uint32_t> _offsets; // nodes of every used feature: range [offsets[i], offsets[i + 1])
+  std::vector<double> _thresholds; // splitting values of the nodes
+  std::vector<std::uint64_t> _masks; // _words masks per node
+  std::vector<std::uint32_t> _leafNodes; // index in the node array of every leaf
+};
+
+// Nodes of a trained tree: owned by the tree after train() OR read in place from a model file after load()
+class NodeArray {
+public:
+  NodeArray() {}
+  NodeArray(const NodeArray& other) { *this = other; }
+  NodeArray& operator=(const NodeArray& other) {
+    _owned = other._owned;
+    _file = other._file;
+    _data = (_file == nullptr) ? _owned.data() : other._data;
+    _size = other._size;
+    return *this;
+  }
+
+  void assign(std::vector<CompactNode>&& nodes) {
+    _owned = std::move(nodes);
+    _file.reset();
+    _data = _owned.data();
+    _size = _owned.size();
+  }
+  void map(const std::shared_ptr<const MappedFile>& file, const CompactNode* data, const std::size_t& size) {
+    std::vector<CompactNode>().swap(_owned);
+    _file = file;
+    _data = data;
+    _size = size;
+  }
+  const CompactNode* data() const { return _data; }
+  std::size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+  const CompactNode& operator[](const std::size_t& i) const { return _data[i]; }
+  // nodes of a tree trained in this session, e.g. for the boosting rounds to set the leaf values
+  CompactNode* ownedData() { return _owned.data(); }
+
+private:
+  std::vector<CompactNode> _owned;
+  std::shared_ptr<const MappedFile> _file; // mapped model file, the nodes point into it
+  const CompactNode* _data = nullptr;
+  std::size_t _size = 0;
+};
+
+// Random stream (splitmix64) owned by a node of the tree during training.
+// The stream of every node is derived from the stream of its parent, so that the sampled features do not
+// depend on the order in which the threads build the nodes.
+class RandomStream {
+public:
+  explicit RandomStream(const std::uint64_t& seed): _state(seed) {}
+
+  std::uint64_t next() {
+    std::uint64_t z = (_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+  // uniform integer in [0, n)
+  arma::uword below(const arma::uword& n) {
+    return (arma::uword)(next() % (std::uint64_t)n);
+  }
+  // seed of the child stream number "child"
+  static std::uint64_t derive(const std::uint64_t& seed, const std::uint64_t& child) {
+    return RandomStream(seed ^ (child * 0xD1B54A32D192ED03ULL)).next();
+  }
+
+private:
+  std::uint64_t _state;
+};
+
+// Running label statistics on one side of a regression split.
+// Labels are pushed shifted by the node mean so that the sum of squares does not lose precision.
+struct RegressionStats {
+  double _count = 0.0;
+  double _sum = 0.0;
+  double _sumSq = 0.0;
+
+  void add(const double& y) {
+    _count += 1.0;
+    _sum += y;
+    _sumSq += y * y;
+  }
+  void remove(const double& y) {
+    _count -= 1.0;
+    _sum -= y;
+    _sumSq -= y * y;
+  }
+  // label of a data point standing for "weight" data points (approximate split search)
+  void add(const double& y, const double& weight) {
+    _count += weight;
+    _sum += weight * y;
+    _sumSq += weight * y * y;
+  }
+  void remove(const double& y, const double& weight) {
+    _count -= weight;
+    _sum -= weight * y;
+    _sumSq -= weight * y * y;
+  }
+  void add(const RegressionStats& other) {
+    _count += other._count;
+    _sum += other._sum;
+    _sumSq += other._sumSq;
+  }
+  void remove(const RegressionStats& other) {
+    _count -= other._count;
+    _sum -= other._sum;
+    _sumSq -= other._sumSq;
+  }
+  // sum of squared deviations from the mean
+  double sse() const {
+    return _count > 0.0 ? _sumSq - _sum * _sum / _count : 0.0;
+  }
+};
+
+// Hot-path statistics of a training, collected when the collectStats property of the tree is on.
+// The phases are timed by every thread, so that their seconds add up the time of all the threads.
+struct TrainingStats {
+  double _prepareSeconds = 0.0; // building the dataset: storage, presorted columns OR bins
+  double _sortSeconds = 0.0; // sorting the rows of the nodes by the sampled features
+  double _scanSeconds = 0.0; // reading the data of the nodes: columns, nonzeros OR histograms
+  double _evalSeconds = 0.0; // sweeping the thresholds and computing their Gini / MSE scores
+  double _partitionSeconds = 0.0; // sending the rows of the split nodes to their children
+  double _leafSeconds = 0.0; // computing the values of the leaves
+  double _totalSeconds = 0.0; // wall time of the training
+  double _candidates = 0.0; // thresholds scored
+  double _bytesAllocated = 0.0; // bytes allocated by the training buffers and nodes
+  double _nodes = 0.0; // nodes of the trained tree
+  double _maxDepth = 0.0; // depth of the trained tree
+
+  void add(const TrainingStats& other) {
+    _prepareSeconds += other._prepareSeconds;
+    _sortSeconds += other._sortSeconds;
+    _scanSeconds += other._scanSeconds;
+    _evalSeconds += other._evalSeconds;
+    _partitionSeconds += other._partitionSeconds;
+    _leafSeconds += other._leafSeconds;
+    _candidates += other._candidates;
+    _bytesAllocated += other._bytesAllocated;
+  }
+};
+
+// Adds the time spent in its scope to a timer of TrainingStats. A null timer (statistics off) costs one branch.
+class PhaseTimer {
+public:
+  explicit PhaseTimer(double* seconds): _seconds(seconds) {
+    if (_seconds != nullptr) {
+      _start = std::chrono::steady_clock::now();
+    }
+  }
+  ~PhaseTimer() {
+    if (_seconds != nullptr) {
+      *_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+    }
+  }
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+  double* _seconds;
+  std::chrono::steady_clock::time_point _start;
+};
+
+// Node of a tree grown by update(): label statistics of the rows seen by the node while it is a leaf.
+// The statistics of the bins are the ones of the rows seen since the leaf was created, the totals also hold the
+// rows of the parent which went to the leaf, so that the value of a new leaf does not start from nothing.
+struct OnlineLeaf {
+  arma::uword _depth = 0;
+  arma::uvec _features; // features sampled by the leaf
+  std::vector<arma::uword> _offsets; // first bin of every sampled feature in the histogram
+  arma::mat _histogram; // bin statistics (one column per bin): count, class counts (classification)
+                        // OR count, sum, sum of squares (regression)
+  arma::vec _totals; // statistics of all the rows of the leaf
+  double _pending = 0.0; // rows seen since the last check of the split
+};
+
 //' @name Tree
 //' @title CART (classification and regression tree)
 //' @description CART is an efficient realization of classification and regression tree model in R
@@ -101,16 +388,85 @@ public:
 //' \item Parameter: numFeatures - number of features selected at each split
 //' \item Parameter: maxDepth - the maximum depth to which the tree is grown
 //' \item Parameter: minCount - minimum number of data points for a node to qualify as a leaf node
+//' \item Parameter: splitMethod - (optional) 0 to sort the data points at every node, 1 to presort the features
+//' once per training and 2 to search the splits over at most 255 quantile bins of every feature
 //' }
 //' @field train Train the CART model on the data. This method recursively builds the tree until some pre-specified
 //' (in the constructor) stopping criteria is reached. \itemize{
-//' \item Parameter: X - data matrix
-//' \item Parameter: Y - vector of labels
+//' \item Parameter: X - data matrix, dense or sparse (dgCMatrix, with splitMethod = 0), OR path of a data file
+//' written by writeColumns or csvToColumns, which is memory-mapped instead of being loaded in memory (data larger
+//' than memory: splitMethod = 0 with featureStorage = 0, OR splitMethod = 2, see \code{Tree$train})
+//' \item Parameter: Y - vector of labels (not given with a data file)
+//' }
+//' X may also be a Dataset, which keeps its preprocessing between the trainings. The labels are those of the dataset
+//' and the tree trains on all its rows, OR on the rows given by a second parameter (starting with 1, possibly
+//' repeated), OR on these rows weighted by the whole numbers of a third parameter.
+//' @field update Grow the tree incrementally on a batch of new data (Hoeffding tree): every leaf keeps the binned
+//' label statistics of the rows it has seen and is split once the Hoeffding bound settles its best split.
+//' \itemize{
+//' \item Parameter: X - data matrix of the batch
+//' \item Parameter: Y - vector of labels of the batch
+//' }
+//' @field hoeffdingDelta Probability that update splits a leaf on a split which is not the best one, 1e-7 by
+//' default
+//' @field gracePeriod Number of rows seen by a leaf between two checks of its split by update, 200 by default
+//' @field tieThreshold Difference of merit under which update splits a leaf on the best of two tied splits, 0.05
+//' by default. The merit of a split is its Gini gain (classification) OR its share of the explained variance
+//' (regression)
 //' @field predict Calculate predictions based on the CART model. This method makes predictions based on the data,
 //' using the tree model. The predictions are based on the decision rules created in the training stage. \itemize{
-//' \item Parameter: X - data matrix, based on which predictions are made
+//' \item Parameter: X - data matrix (dense or sparse), based on which predictions are made
+//' \item Parameter: numThreads - (optional) number of threads used for the predictions
 //' \item Returns: Y - vector of predicted values
 //' }
+//' @field save Save the trained model to a binary file. \itemize{
+//' \item Parameter: path - path of the model file
+//' }
+//' @field load Load a model saved by save. The file is memory-mapped and used in place by predict and print.
+//' \itemize{
+//' \item Parameter: path - path of the model file
+//' }
+//' @field numThreads Number of threads used to train the tree, 1 by default. Large nodes close to the root evaluate
+//' their features in parallel and the subtrees below them are built as parallel tasks. The features sampled at
+//' every node come from a random stream seeded from R's RNG, so that the trained tree does not depend on the
+//' number of threads.
+//' @field featureStorage Storage of the training data, 0 by default. 0 reads the double matrix in place, 1 trains on
+//' a float32 copy (half the memory of the data) and 2 on uint16 codes of at most 65535 quantiles of every feature
+//' (a quarter of the memory, exact for the features with at most 65535 distinct values). The splitting values are
+//' mapped back to double precision, so that predictions on the double data send the training rows the same way.
+//' Sparse data is always kept in double precision.
+//' @field quickScorer Prediction engine of trees of depth <= 8, which can also be scored in their bitvector
+//' (QuickScorer) form: the splits are grouped by feature and every row masks out the leaves left of the splits it goes
+//' right at. -1 (default) uses the bitvector form when its number of splits is small compared to the number of features,
+//' where it is faster than the traversal of the nodes, 0 never uses it and 1 uses it whenever the depth allows it. The
+//' predictions are the same.
+//' @field maxLeaves Maximum number of leaves of the tree, 0 (default) for no limit. With a limit, the tree is grown
+//' best-first: the nodes wait in a queue ordered by the gain of their best split, which is searched once when they
+//' enter it, and the node with the largest gain is split until the tree has maxLeaves leaves. maxDepth and minCount
+//' still apply.
+//' @field minGain Smallest gain of a split, 0 by default: a node whose best split decreases the impurity of the
+//' tree (Gini index OR variance of the labels, weighted by the share of the training rows in the node) by less
+//' becomes a leaf
+//' @field approxMinRows Size above which the nodes search their split on a sample of their rows, 0 (default) for
+//' the exact search at every node. The sample of a classification tree is stratified by class, the one of a
+//' regression tree is drawn by gradient-based one-side sampling (half of it are the rows farthest from the node mean,
+//' the other half is drawn at random among the other rows and weighted up to them). The rows of the node are still
+//' all partitioned by the chosen split, and the smaller nodes search it exactly. The histogram mode
+//' (splitMethod = 2) always searches on all the rows.
+//' @field approxSampleSize Number of rows of the sample of a node above approxMinRows, 10000 by default
+//' @field collectStats Whether the trainings collect their statistics, FALSE by default. The timers and counters
+//' are kept per thread and cost a branch when they are off.
+//' @field stats Statistics of the last training collected with collectStats = TRUE (an empty vector otherwise),
+//' as a named vector. \itemize{
+//' \item prepareSeconds - building the dataset (storage, presorted columns or bins)
+//' \item sortSeconds, scanSeconds, evalSeconds, partitionSeconds, leafSeconds - time spent sorting the rows of the
+//' nodes, reading their data (columns, nonzeros or histograms), scoring the thresholds (Gini or MSE), partitioning
+//' the split nodes and computing the leaves, added up over the threads
+//' \item totalSeconds - wall time of the training
+//' \item candidates - number of thresholds scored
+//' \item bytesAllocated - bytes allocated by the training buffers and the nodes
+//' \item nodes, maxDepth - nodes and depth of the trained tree
+//' }
 //' @field print Print the tree structure of the model. The consecutive rows of matrix represent the nodes. The way
 //' the matrix is formed is: first, the node is printed, then the recursive calls are made to print its left and
 //' right child nodes respectively. Due to the recursive nature of the print function, the matrix representing the
@@ -137,6 +493,9 @@ public:
 //' tr$predict(Xtest)
 //' # Print tree structure
 //' tr$print()
+//' # Train the tree with 2 threads
+//' tr$numThreads = 2
+//' tr$train(X, Y)
 //'
 //' # Regression tree example
 //' X = matrix(1:12, nrow = 6, ncol = 2, byrow = TRUE)
@@ -158,21 +517,154 @@ public:
   Tree();
   Tree(const int& ident, const int& treeType, const arma::uword& maxNumFeatures,
        const arma::uword& numFeatures, const int& maxDepth, const int& minCount);
+  Tree(const int& ident, const int& treeType, const arma::uword& maxNumFeatures,
+       const arma::uword& numFeatures, const int& maxDepth, const int& minCount,
+       const int& splitMethod);
 
   // public methods
-  void train(arma::mat& X, arma::colvec& Y);
+  void train(const arma::mat& X, const arma::colvec& Y);
+  void train(const arma::sp_mat& X, const arma::colvec& Y);
+  void train(const std::string& path);
+  void train(const Dataset& data, const arma::uvec& rows, const std::uint64_t& seed);
+  void train(Dataset& data);
+  void train(Dataset& data, const arma::uvec& rows);
+  void train(Dataset& data, const arma::uvec& rows, const arma::vec& weights);
+  void update(const arma::mat& X, const arma::colvec& Y);
+  double getHoeffdingDelta() const;
+  void setHoeffdingDelta(double hoeffdingDelta);
+  int getGracePeriod() const;
+  void setGracePeriod(int gracePeriod);
+  double getTieThreshold() const;
+  void setTieThreshold(double tieThreshold);
+  int getNumThreads() const;
+  void setNumThreads(int numThreads);
+  int getQuickScorer() const;
+  void setQuickScorer(int quickScorer);
+  int getFeatureStorage() const;
+  void setFeatureStorage(int featureStorage);
+  int getMaxLeaves() const;
+  void setMaxLeaves(int maxLeaves);
+  double getMinGain() const;
+  void setMinGain(double minGain);
+  int getApproxMinRows() const;
+  void setApproxMinRows(int approxMinRows);
+  int getApproxSampleSize() const;
+  void setApproxSampleSize(int approxSampleSize);
+  bool getCollectStats() const;
+  void setCollectStats(bool collectStats);
+  std::map<std::string, double> stats() const;
   arma::colvec predict(const arma::mat& X) const;
+  arma::colvec predict(const arma::mat& X, const int& numThreads) const;
+  arma::colvec predict(const arma::sp_mat& X) const;
+  arma::colvec predict(const arma::sp_mat& X, const int& numThreads) const;
   arma::mat print() const;
+  void save(const std::string& path) const;
+  void load(const std::string& path);
+#ifdef CARTCPP_STANDALONE
+  static void seedRandom(const std::uint64_t& seed);
+#endif
+
+  // ensembles train their trees on a shared dataset and predict with the flat layout of the trees
+  friend class Forest;
+  friend class Booster;
 
 protected:
   // protected methods
-  void printNode(Node* nd, arma::mat& tr) const;
-  void buildTree(Node* nd, arma::mat &X, arma::colvec &Y);
-  bool stop(const Node* nd, arma::colvec &Y) const;
-  bool split(Node* nd, arma::mat &X, arma::colvec &Y);
-  void classResult(Node* nd, arma::colvec &Y) const;
-  double gini(const std::map<double, int>& classSetLeft, const std::map<double, int>& classSetRight,
-              const double& totalSize) const;
+  void printNode(const std::uint32_t& nd, const arma::uword& depth, arma::mat& tr, arma::uword& row) const;
+  void trainRows(Dataset& data, const arma::uvec& rows, const std::chrono::steady_clock::time_point& start);
+  void compile(const Node* root);
+  arma::uword predictBlockSize() const;
+  static void fillTile(const arma::mat& X, const arma::uword& first, const arma::uword& size, double* tile);
+  void descendBlock(const arma::mat& X, const arma::uword& first, const arma::uword& size, const double* tile,
+                    std::uint32_t* nodeIndex) const;
+  void buildBitvectors();
+  bool useBitvectors() const;
+  template <arma::uword W>
+  void scoreBitvectors(const arma::mat& X, const arma::uword& first, const arma::uword& size,
+                       std::uint32_t* nodeIndex) const;
+  double predictRow(const arma::mat& X, const arma::uword& row) const;
+  double predictRow(const arma::sp_mat& rowMajor, const arma::uword& row) const;
+  double predictRow(const Dataset& data, const arma::uword& row) const;
+  void buildTree(Node* nd, const arma::mat &X, const arma::colvec &Y);
+  bool stop(const Node* nd, const arma::colvec &Y) const;
+  // label statistics of all the data points of a node
+  struct NodeStats {
+    arma::vec _classCounts; // classification: count of every class code
+    double _squares = 0.0; // classification: sum of the squared class counts
+    RegressionStats _regression; // regression: statistics of the labels centered at the mean
+    double _mean = 0.0; // regression: mean of the labels
+  };
+  // best split of a node along one feature
+  struct SplitCandidate {
+    bool _found = false;
+    double _score = std::numeric_limits<double>::infinity(); // Gini score OR MSE of the split
+    arma::uword _featureIndex = 0;
+    double _splitValue = 0.0;
+  };
+  // approximate split search: rows of the sample of a node, the weight of every row (number of rows of the node it
+  // stands for) and the weighted label statistics of the sample
+  struct RowSample {
+    std::vector<arma::uword> _rows;
+    std::vector<double> _weights;
+    NodeStats _totals;
+  };
+  // scratch space of a thread, reused by all the nodes built by the thread
+  struct Workspace {
+    std::vector<std::pair<double, arma::uword>> _sortBuffer; // exact mode: values and rows sorted by a feature
+    std::vector<arma::uword> _rowBuffer; // rows moving to the right child during a partition
+    std::vector<double> _countsLeft; // classification: class counts of both sides of a split
+    std::vector<double> _countsRight;
+    std::vector<double> _countsZero; // sparse data, classification: class counts of the zeros of a feature
+    std::vector<arma::uword> _featureSlots; // sparse data: position of every feature among the sampled ones
+    TrainingStats _stats; // statistics of the nodes built by the thread
+  };
+  Workspace& workspace() const;
+  double* timer(double TrainingStats::* phase) const;
+  void countCandidates(const arma::uword& count) const;
+  void countBytes(const double& bytes) const;
+  void acquireHistogram(Node* nd);
+  void releaseHistogram(Node* nd);
+  void releaseNode(Node* nd);
+  void growBestFirst(Node* root, const arma::mat &X, const arma::colvec &Y);
+  bool searchSplit(Node* nd, const arma::mat &X, const arma::colvec &Y);
+  void splitNode(Node* nd, const arma::mat &X, const arma::colvec &Y);
+  bool findSplit(Node* nd, const arma::mat &X, const arma::colvec &Y);
+  NodeStats nodeStats(const Node* nd, const arma::colvec &Y) const;
+  SplitCandidate scanFeature(const Node* nd, const arma::uword& feature, const arma::mat &X, const arma::colvec &Y,
+                             const NodeStats& totals, const std::uint32_t* rowCounts) const;
+  template <typename T>
+  SplitCandidate scanColumn(const Node* nd, const arma::uword& feature, const T* column, const arma::colvec &Y,
+                            const NodeStats& totals, const std::uint32_t* rowCounts) const;
+  bool approximate(const Node* nd) const;
+  RowSample sampleRows(const Node* nd, const arma::colvec &Y, const NodeStats& totals) const;
+  SplitCandidate scanSample(const arma::uword& feature, const RowSample& sample, const arma::colvec &Y) const;
+  std::vector<arma::uword> gatherNonzeros(const Node* nd, const arma::uvec& features,
+                                          std::vector<std::pair<double, arma::uword>>& nonzeros) const;
+  SplitCandidate scanNonzeros(const Node* nd, const arma::uword& feature, std::pair<double, arma::uword>* nonzeros,
+                              const arma::uword& numNonzeros, const arma::colvec &Y, const NodeStats& totals) const;
+  void partition(Node* nd, const arma::mat &X);
+  arma::uword partitionRange(arma::uword* rows, const arma::uword& size, const char* goesLeft) const;
+  std::vector<std::uint32_t> countRows(const Node* nd) const;
+  void walkSorted(const arma::uword& feature, const std::uint32_t* rowCounts, arma::uword* rows) const;
+  void sortBlock(Node* nd);
+  void partitionSorted(Node* nd);
+  void buildHistogram(Node* nd, const arma::colvec &Y);
+  bool findSplitHistogram(Node* nd);
+  void splitHistograms(Node* nd, const arma::colvec &Y);
+  double histogramScore(const double* left, const double* right, const arma::uword& numClasses) const;
+  bool canSplit(const Node* nd) const;
+  arma::uvec sampleFeatures(const std::uint64_t& seed) const;
+  bool parallelFeatures(const Node* nd) const;
+  static std::uint64_t drawSeed();
+  void classResult(Node* nd, const arma::colvec &Y) const;
+  double gini(const double* countsLeft, const double* countsRight, const arma::uword& numClasses,
+              const double& leftSize, const double& rightSize) const;
+  void startOnline(const arma::mat& X, const arma::colvec& Y);
+  void addOnlineLeaf(const arma::uword& depth, const arma::vec& totals);
+  arma::uword onlineCode(const double& label);
+  bool splitOnline(const std::uint32_t& nd);
+  double onlineValue(const arma::vec& totals) const;
+  void clearOnline();
 protected:
   // protected fields
   int _id;
@@ -181,7 +673,36 @@ protected:
   arma::uword _numFeatures; // number of features selected at each split
   int _maxDepth; // maxDepth of tree
   int _minCount; // min count of points for a leaf
-  Node* _root;
+  int _splitMethod = 0; // splitMethod 0: sort the rows at every node OR 1: presort the columns once per train()
+                        // OR 2: quantize the columns into bins once per train()
+  int _numThreads = 1; // number of threads building the tree
+  int _featureStorage = 0; // storage of the training data 0: double OR 1: float32 OR 2: uint16 codes
+  arma::uword _rootSize = 0; // number of data points of the root node
+  arma::uvec _rows; // training row arena: the data points of every node are a contiguous range of it
+  std::vector<char> _goesLeft; // side of the split taken by each row of the data
+  mutable std::vector<Workspace> _workspaces; // one per thread
+  int _parallelLevel = 0; // nesting level of the parallel region building the tree, the only one using workspaces
+  std::vector<arma::mat> _histogramPool; // histogram mode: released histograms, reused by the next nodes
+  const Dataset* _data = nullptr; // preprocessed training data, only set during train()
+  NodeArray _nodes; // trained tree
+  arma::uword _treeDepth = 0; // depth of the trained tree
+  BitvectorTree _bitvectors; // bitvector form of a shallow trained tree
+  int _quickScorer = -1; // predict with the bitvector form -1: when it is cheaper, 0: never, 1: whenever the tree has one
+  int _maxLeaves = 0; // grow the tree best-first up to maxLeaves leaves, 0: depth-first without a limit
+  double _minGain = 0.0; // smallest decrease of the impurity of the tree by a split
+  int _approxMinRows = 0; // nodes with more rows search their split on a sample, 0: exact search at every node
+  int _approxSampleSize = 10000; // rows of the sample of the approximate search
+  bool _collectStats = false; // collect the statistics of the trainings
+  TrainingStats _stats; // statistics of the last training
+  std::vector<CompactNode> _onlineNodes; // update(): nodes grown so far, copied to _nodes after every update
+  std::vector<OnlineLeaf> _onlineLeaves; // update(): statistics of every node, emptied once the node is split
+  std::vector<arma::vec> _onlineEdges; // update(): largest value of every bin of every feature, from the first batch
+  std::vector<double> _onlineClasses; // update(), classification: class of every code, in order of appearance
+  double _onlineShift = 0.0; // update(), regression: mean of the labels of the first batch
+  std::uint64_t _onlineSeed = 0; // update(): seed of the random streams of the nodes
+  double _hoeffdingDelta = 1e-7; // update(): probability of splitting a leaf on a split which is not the best one
+  int _gracePeriod = 200; // update(): rows seen by a leaf between two checks of its split
+  double _tieThreshold = 0.05; // update(): difference of merit under which two splits are tied
 };
 
 #endif
@@ -4,14 +4,122 @@
 
 // Include our definition of the Tree file (e.g. "")
 #include "Tree.h"
+#include "Forest.h"
+#include "Booster.h"
+#include "ColumnFile.h"
+
+// Dataset objects are passed from R to the train methods by reference
+RCPP_EXPOSED_CLASS_NODECL(Dataset)
+
+// Overloads with the same number of arguments: the sparse one is chosen for a dgCMatrix (registered first)
+template <int N>
+bool sparseArgs(SEXP* args, int nargs) {
+  return nargs == N && Rf_inherits(args[0], "dgCMatrix");
+}
+
+// Overloads taking a Dataset object (registered before the overloads with the same number of arguments)
+template <int N>
+bool datasetArgs(SEXP* args, int nargs) {
+  return nargs == N && Rf_inherits(args[0], "Rcpp_Dataset");
+}
+
+// Dataset of R data: with the double storage (0), a double matrix is used in place and kept alive by the dataset
+// (the other matrices are converted once). The float32 (1) and uint16 (2) storages copy the values, so that the R
+// matrix is not kept.
+Dataset* newDataset(SEXP X, SEXP Y, int treeType, int storage) {
+  if (treeType < 0 || treeType > 1) {
+    throw std::range_error("Tree type should be either 0 or 1");
+  }
+  if (Rf_inherits(X, "dgCMatrix")) {
+    if (storage != 0) {
+      throw std::range_error("Sparse data is kept in double precision (storage 0)");
+    }
+    return new Dataset(Rcpp::as<arma::sp_mat>(X), Rcpp::as<arma::colvec>(Y), treeType);
+  }
+  Rcpp::NumericMatrix matrix(X);
+  std::unique_ptr<Dataset> data(new Dataset(arma::mat(matrix.begin(), matrix.nrow(), matrix.ncol(), false, true),
+                                            Rcpp::as<arma::colvec>(Y), treeType, storage));
+  if (storage == 0) {
+    data->_owner = std::make_shared<Rcpp::NumericMatrix>(matrix);
+  }
+  return data.release();
+}
+
+Dataset* newDoubleDataset(SEXP X, SEXP Y, int treeType) {
+  return newDataset(X, Y, treeType, 0);
+}
 
 // Expose (some of) the Student class
 RCPP_MODULE(RcppTreeEx){
+  Rcpp::function("writeColumns", &writeColumns, Rcpp::List::create(Rcpp::_["X"], Rcpp::_["Y"], Rcpp::_["path"]));
+  Rcpp::function("csvToColumns", &csvToColumns,
+                 Rcpp::List::create(Rcpp::_["csvPath"], Rcpp::_["path"], Rcpp::_["labelColumn"],
+                                    Rcpp::_["header"] = true));
+
+  Rcpp::class_<Dataset>("Dataset")
+  .factory<SEXP, SEXP, int>(&newDoubleDataset)
+  .factory<SEXP, SEXP, int, int>(&newDataset)
+  .method("prepare", &Dataset::prepare)
+  .field_readonly("numRows", &Dataset::_numRows)
+  .field_readonly("numCols", &Dataset::_numCols);
+
   Rcpp::class_<Tree>("Tree")
   .default_constructor()
   .constructor<int, int, arma::uword, arma::uword, int, int>()
-  .method("train", &Tree::train)
-  .method("predict", &Tree::predict)
-  .method("train", &Tree::train)
-  .method("print", &Tree::print);
+  .constructor<int, int, arma::uword, arma::uword, int, int, int>()
+  .method("train", (void (Tree::*)(Dataset&))(&Tree::train), "", &datasetArgs<1>)
+  .method("train", (void (Tree::*)(Dataset&, const arma::uvec&))(&Tree::train), "", &datasetArgs<2>)
+  .method("train", (void (Tree::*)(Dataset&, const arma::uvec&, const arma::vec&))(&Tree::train), "",
+          &datasetArgs<3>)
+  .method("train", (void (Tree::*)(const arma::sp_mat&, const arma::colvec&))(&Tree::train), "", &sparseArgs<2>)
+  .method("predict", (arma::colvec (Tree::*)(const arma::sp_mat&) const)(&Tree::predict), "", &sparseArgs<1>)
+  .method("predict", (arma::colvec (Tree::*)(const arma::sp_mat&, const int&) const)(&Tree::predict), "",
+          &sparseArgs<2>)
+  .method("train", (void (Tree::*)(const arma::mat&, const arma::colvec&))(&Tree::train))
+  .method("train", (void (Tree::*)(const std::string&))(&Tree::train))
+  .method("predict", (arma::colvec (Tree::*)(const arma::mat&) const)(&Tree::predict))
+  .method("predict", (arma::colvec (Tree::*)(const arma::mat&, const int&) const)(&Tree::predict))
+  .method("train", (void (Tree::*)(const arma::mat&, const arma::colvec&))(&Tree::train))
+  .method("print", &Tree::print)
+  .method("save", &Tree::save)
+  .method("load", &Tree::load)
+  .method("update", &Tree::update)
+  .method("stats", &Tree::stats)
+  .property("numThreads", &Tree::getNumThreads, &Tree::setNumThreads)
+  .property("quickScorer", &Tree::getQuickScorer, &Tree::setQuickScorer)
+  .property("featureStorage", &Tree::getFeatureStorage, &Tree::setFeatureStorage)
+  .property("maxLeaves", &Tree::getMaxLeaves, &Tree::setMaxLeaves)
+  .property("minGain", &Tree::getMinGain, &Tree::setMinGain)
+  .property("approxMinRows", &Tree::getApproxMinRows, &Tree::setApproxMinRows)
+  .property("approxSampleSize", &Tree::getApproxSampleSize, &Tree::setApproxSampleSize)
+  .property("collectStats", &Tree::getCollectStats, &Tree::setCollectStats)
+  .property("hoeffdingDelta", &Tree::getHoeffdingDelta, &Tree::setHoeffdingDelta)
+  .property("gracePeriod", &Tree::getGracePeriod, &Tree::setGracePeriod)
+  .property("tieThreshold", &Tree::getTieThreshold, &Tree::setTieThreshold);
+
+  Rcpp::class_<Forest>("Forest")
+  .constructor<int, int, arma::uword, arma::uword, int, int>()
+  .constructor<int, int, arma::uword, arma::uword, int, int, int>()
+  .method("train", (void (Forest::*)(const arma::mat&, const arma::colvec&))(&Forest::train))
+  .method("train", (void (Forest::*)(const std::string&))(&Forest::train))
+  .method("predict", (arma::colvec (Forest::*)(const arma::mat&) const)(&Forest::predict))
+  .method("predict", (arma::colvec (Forest::*)(const arma::mat&, const int&) const)(&Forest::predict))
+  .property("numThreads", &Forest::getNumThreads, &Forest::setNumThreads)
+  .property("featureStorage", &Forest::getFeatureStorage, &Forest::setFeatureStorage)
+  .property("oobError", &Forest::getOobError);
+
+  Rcpp::class_<Booster>("Booster")
+  .constructor<int, int, arma::uword, arma::uword, int, int>()
+  .constructor<int, int, arma::uword, arma::uword, int, int, int>()
+  .method("train", (void (Booster::*)(const arma::mat&, const arma::colvec&))(&Booster::train))
+  .method("train", (void (Booster::*)(const arma::mat&, const arma::colvec&, const arma::mat&, const arma::colvec&))(
+    &Booster::train))
+  .method("predict", (arma::colvec (Booster::*)(const arma::mat&) const)(&Booster::predict))
+  .method("predict", (arma::colvec (Booster::*)(const arma::mat&, const int&) const)(&Booster::predict))
+  .property("learningRate", &Booster::getLearningRate, &Booster::setLearningRate)
+  .property("subsample", &Booster::getSubsample, &Booster::setSubsample)
+  .property("earlyStopping", &Booster::getEarlyStopping, &Booster::setEarlyStopping)
+  .property("numThreads", &Booster::getNumThreads, &Booster::setNumThreads)
+  .property("featureStorage", &Booster::getFeatureStorage, &Booster::setFeatureStorage)
+  .property("numTrees", &Booster::getNumTrees);
 }